@@ -0,0 +1,592 @@
+// Benchmarks of the smart pointers against their `std::` equivalents.
+//
+//     g++ -std=c++17 -O2 -I. bench/bench.cpp -o bench -pthread
+//     ./bench [--json] [--filter=<substring>] [--threads=<max>] [--scale=<factor>]
+//
+// Every case is run for this repo ("sp") and for the standard library ("std") and reports
+// nanoseconds and heap allocations per operation. On Linux the cycles, instructions,
+// cache misses and branch misses per operation are read through `perf_event_open` when the
+// kernel allows it, otherwise they are reported as unavailable. `--json` prints one JSON
+// object per line instead of the table, for regression tracking.
+
+#include "shared/biased.h"
+#include "shared/shared.h"
+#include "shared/shared_ref.h"
+#include "shared/shared_pool.h"
+#include "shared/weak.h"
+#include "unique/unique.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Allocation counting
+
+namespace {
+
+std::atomic<uint64_t> allocations = 0;
+
+}  // namespace
+
+// Kept out of line, GCC otherwise sees `free` applied to the result of `operator new`
+[[gnu::noinline]] void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+[[gnu::noinline]] void* operator new(size_t size, std::align_val_t alignment) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    size_t align = static_cast<size_t>(alignment);
+    if (void* ptr = std::aligned_alloc(align, (size + align - 1) / align * align)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+[[gnu::noinline]] void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+[[gnu::noinline]] void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+[[gnu::noinline]] void operator delete(void* ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+[[gnu::noinline]] void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+namespace {
+
+// Hardware counters
+
+class PerfCounters {
+public:
+    static constexpr size_t kCount = 4;
+    static constexpr std::array<const char*, kCount> kNames = {"cycles", "instructions",
+                                                               "cache_misses", "branch_misses"};
+    using Values = std::array<double, kCount>;
+
+    PerfCounters() {
+        fds_.fill(-1);
+#ifdef __linux__
+        static constexpr std::array<uint64_t, kCount> kConfigs = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_BRANCH_MISSES};
+        for (size_t i = 0; i < kCount; ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = kConfigs[i];
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            // Threads started by a case are counted too
+            attr.inherit = 1;
+            fds_[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+#endif
+    }
+    ~PerfCounters() {
+#ifdef __linux__
+        for (int fd : fds_) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    void Start() {
+#ifdef __linux__
+        for (int fd : fds_) {
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+    // Counts since `Start`, negative for counters that are not available
+    Values Stop() {
+        Values values;
+        values.fill(-1);
+#ifdef __linux__
+        for (size_t i = 0; i < kCount; ++i) {
+            uint64_t count = 0;
+            if (fds_[i] >= 0) {
+                ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+                if (read(fds_[i], &count, sizeof(count)) == sizeof(count)) {
+                    values[i] = static_cast<double>(count);
+                }
+            }
+        }
+#endif
+        return values;
+    }
+
+private:
+    std::array<int, kCount> fds_;
+};
+
+// Measurement
+
+template <typename T>
+void Escape(const T& value) {
+    asm volatile("" : : "r"(&value) : "memory");
+}
+
+struct Options {
+    bool json = false;
+    std::string filter;
+    size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    double scale = 1.0;
+};
+
+struct Result {
+    std::string name;
+    std::string impl;
+    size_t threads = 1;
+    double ns_per_op = 0;
+    double allocs_per_op = 0;
+    PerfCounters::Values counters_per_op;
+};
+
+class Runner {
+public:
+    explicit Runner(Options options) : options_(std::move(options)) {
+    }
+
+    // Runs `body(iterations)` a few times and reports the fastest run. One iteration does
+    // `ops_per_iteration` operations over all `threads`, time is per operation and thread.
+    void Run(const std::string& name, const std::string& impl, size_t threads, size_t iterations,
+             const std::function<void(size_t)>& body, size_t ops_per_iteration = 1) {
+        if (name.find(options_.filter) == std::string::npos) {
+            return;
+        }
+        iterations = std::max<size_t>(1, static_cast<size_t>(iterations * options_.scale));
+        body(iterations / 10 + 1);
+        Result best;
+        best.ns_per_op = -1;
+        for (int repetition = 0; repetition < kRepetitions; ++repetition) {
+            double ops = static_cast<double>(iterations * ops_per_iteration);
+            uint64_t allocs_before = allocations.load(std::memory_order_relaxed);
+            counters_.Start();
+            auto start = std::chrono::steady_clock::now();
+            body(iterations);
+            auto finish = std::chrono::steady_clock::now();
+            PerfCounters::Values counters = counters_.Stop();
+            uint64_t allocs = allocations.load(std::memory_order_relaxed) - allocs_before;
+
+            double ns = std::chrono::duration<double, std::nano>(finish - start).count() *
+                        static_cast<double>(threads) / ops;
+            if (best.ns_per_op >= 0 && ns >= best.ns_per_op) {
+                continue;
+            }
+            best.ns_per_op = ns;
+            best.allocs_per_op = static_cast<double>(allocs) / ops;
+            for (size_t i = 0; i < PerfCounters::kCount; ++i) {
+                best.counters_per_op[i] = counters[i] < 0 ? -1 : counters[i] / ops;
+            }
+        }
+        best.name = name;
+        best.impl = impl;
+        best.threads = threads;
+        Print(best);
+    }
+
+    size_t MaxThreads() const {
+        return options_.max_threads;
+    }
+
+    void PrintHeader() const {
+        if (options_.json) {
+            return;
+        }
+        std::printf("%-30s %-7s %7s %10s %10s", "case", "impl", "threads", "ns/op", "allocs/op");
+        for (const char* counter : PerfCounters::kNames) {
+            std::printf(" %14s", counter);
+        }
+        std::printf("\n");
+    }
+
+private:
+    static constexpr int kRepetitions = 5;
+
+    void Print(const Result& result) const {
+        if (options_.json) {
+            std::printf("{\"case\":\"%s\",\"impl\":\"%s\",\"threads\":%zu,\"ns_per_op\":%.3f,"
+                        "\"allocs_per_op\":%.3f",
+                        result.name.c_str(), result.impl.c_str(), result.threads,
+                        result.ns_per_op, result.allocs_per_op);
+            for (size_t i = 0; i < PerfCounters::kCount; ++i) {
+                if (result.counters_per_op[i] < 0) {
+                    std::printf(",\"%s_per_op\":null", PerfCounters::kNames[i]);
+                } else {
+                    std::printf(",\"%s_per_op\":%.3f", PerfCounters::kNames[i],
+                                result.counters_per_op[i]);
+                }
+            }
+            std::printf("}\n");
+        } else {
+            std::printf("%-30s %-7s %7zu %10.2f %10.3f", result.name.c_str(),
+                        result.impl.c_str(), result.threads, result.ns_per_op,
+                        result.allocs_per_op);
+            for (double counter : result.counters_per_op) {
+                if (counter < 0) {
+                    std::printf(" %14s", "n/a");
+                } else {
+                    std::printf(" %14.2f", counter);
+                }
+            }
+            std::printf("\n");
+        }
+        std::fflush(stdout);
+    }
+
+    Options options_;
+    PerfCounters counters_;
+};
+
+// Cases, each is written once over a set of pointer operations
+
+struct Payload {
+    int64_t value[4] = {};
+};
+
+// Stateful deleter, so the pointers cannot compress it away
+struct CountingDeleter {
+    void operator()(Payload* ptr) {
+        if (ptr) {
+            ++*deleted;
+            delete ptr;
+        }
+    }
+    size_t* deleted;
+};
+
+struct Sp {
+    template <typename T>
+    using Shared = SharedPtr<T>;
+    template <typename T>
+    using Weak = WeakPtr<T>;
+    template <typename T, typename D>
+    using Unique = UniquePtr<T, D>;
+
+    template <typename T>
+    static Shared<T> Make() {
+        return MakeShared<T>();
+    }
+    template <typename Ptr>
+    static auto Lock(const Ptr& weak) {
+        return weak.Lock();
+    }
+    template <typename Ptr>
+    static void Reset(Ptr& ptr) {
+        ptr.Reset();
+    }
+    template <typename Ptr, typename T>
+    static void Reset(Ptr& ptr, T* value) {
+        ptr.Reset(value);
+    }
+    template <typename Ptr>
+    static void Swap(Ptr& left, Ptr& right) {
+        left.Swap(right);
+    }
+};
+
+struct Std {
+    template <typename T>
+    using Shared = std::shared_ptr<T>;
+    template <typename T>
+    using Weak = std::weak_ptr<T>;
+    template <typename T, typename D>
+    using Unique = std::unique_ptr<T, D>;
+
+    template <typename T>
+    static Shared<T> Make() {
+        return std::make_shared<T>();
+    }
+    template <typename Ptr>
+    static auto Lock(const Ptr& weak) {
+        return weak.lock();
+    }
+    template <typename Ptr>
+    static void Reset(Ptr& ptr) {
+        ptr.reset();
+    }
+    template <typename Ptr, typename T>
+    static void Reset(Ptr& ptr, T* value) {
+        ptr.reset(value);
+    }
+    template <typename Ptr>
+    static void Swap(Ptr& left, Ptr& right) {
+        left.swap(right);
+    }
+};
+
+template <typename Impl>
+void SharedCases(Runner& runner, const char* impl) {
+    using Shared = typename Impl::template Shared<Payload>;
+    using Weak = typename Impl::template Weak<Payload>;
+    constexpr size_t kFast = 20'000'000;
+    constexpr size_t kAllocating = 2'000'000;
+
+    Shared object = Impl::template Make<Payload>();
+
+    runner.Run("shared_copy_destroy", impl, 1, kFast, [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            Shared copy(object);
+            Escape(copy);
+        }
+    });
+    runner.Run("shared_move", impl, 1, kFast, [&](size_t iterations) {
+        Shared left(object);
+        Shared right;
+        for (size_t i = 0; i < iterations; ++i) {
+            right = std::move(left);
+            Escape(right);
+            left = std::move(right);
+            Escape(left);
+        }
+    }, 2);
+    runner.Run("shared_copy_assign", impl, 1, kFast, [&](size_t iterations) {
+        Shared other = Impl::template Make<Payload>();
+        Shared target;
+        for (size_t i = 0; i < iterations; ++i) {
+            target = (i & 1) ? object : other;
+            Escape(target);
+        }
+    });
+    runner.Run("shared_reset", impl, 1, kFast, [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            Shared copy(object);
+            Impl::Reset(copy);
+            Escape(copy);
+        }
+    });
+    runner.Run("shared_make_destroy", impl, 1, kAllocating, [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            Shared made = Impl::template Make<Payload>();
+            Escape(made);
+        }
+    });
+    runner.Run("shared_new_destroy", impl, 1, kAllocating, [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            Shared made(new Payload());
+            Escape(made);
+        }
+    });
+
+    Weak alive(object);
+    runner.Run("weak_lock_hit", impl, 1, kFast, [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            auto locked = Impl::Lock(alive);
+            Escape(locked);
+        }
+    });
+    Weak expired(Impl::template Make<Payload>());
+    runner.Run("weak_lock_miss", impl, 1, kFast, [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            auto locked = Impl::Lock(expired);
+            Escape(locked);
+        }
+    });
+
+    for (size_t threads = 1; threads <= runner.MaxThreads(); threads *= 2) {
+        runner.Run("shared_contended_copy", impl, threads, kFast / 4, [&](size_t iterations) {
+            std::vector<std::thread> workers;
+            for (size_t t = 0; t < threads; ++t) {
+                workers.emplace_back([&object, iterations] {
+                    for (size_t i = 0; i < iterations; ++i) {
+                        Shared copy(object);
+                        Escape(copy);
+                    }
+                });
+            }
+            for (std::thread& worker : workers) {
+                worker.join();
+            }
+        }, threads);
+    }
+}
+
+template <typename Impl>
+void UniqueCases(Runner& runner, const char* impl) {
+    constexpr size_t kFast = 50'000'000;
+
+    auto run = [&](const std::string& suffix, auto make) {
+        using Unique = decltype(make());
+        runner.Run("unique_move" + suffix, impl, 1, kFast, [&](size_t iterations) {
+            Unique left = make();
+            Unique right = make();
+            for (size_t i = 0; i < iterations; ++i) {
+                right = std::move(left);
+                Escape(right);
+                left = std::move(right);
+                Escape(left);
+            }
+        }, 2);
+        runner.Run("unique_swap" + suffix, impl, 1, kFast, [&](size_t iterations) {
+            Unique left = make();
+            Unique right = make();
+            for (size_t i = 0; i < iterations; ++i) {
+                Impl::Swap(left, right);
+                Escape(left);
+            }
+        });
+        runner.Run("unique_reset" + suffix, impl, 1, kFast / 10, [&](size_t iterations) {
+            Unique ptr = make();
+            for (size_t i = 0; i < iterations; ++i) {
+                Impl::Reset(ptr, new Payload());
+                Escape(ptr);
+            }
+        });
+    };
+
+    using Empty = typename Impl::template Unique<Payload, std::conditional_t<
+        std::is_same_v<Impl, Std>, std::default_delete<Payload>, Slug<Payload>>>;
+    run("_empty_deleter", [] { return Empty(new Payload()); });
+
+    static size_t deleted = 0;
+    using Stateful = typename Impl::template Unique<Payload, CountingDeleter>;
+    run("_stateful_deleter", [] { return Stateful(new Payload(), CountingDeleter{&deleted}); });
+}
+
+// Counting policies of this repo on the same object, against `std::shared_ptr`
+template <typename Policy>
+void PolicyCase(Runner& runner, const char* impl) {
+    auto object = MakeSharedWithPolicy<Payload, Policy>();
+    runner.Run("shared_copy_destroy_policy", impl, 1, 20'000'000, [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            SharedPtr<Payload, Policy> copy(object);
+            Escape(copy);
+        }
+    });
+}
+
+// `MakeShared` against `SharedPool::Make`, which reuses the slots of released blocks
+void PoolCase(Runner& runner) {
+    runner.Run("shared_make_destroy_pool", "make", 1, 2'000'000, [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            auto made = MakeShared<Payload>();
+            Escape(made);
+        }
+    });
+    runner.Run("shared_make_destroy_pool", "pool", 1, 2'000'000, [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            auto made = SharedPool<Payload>::Make();
+            Escape(made);
+        }
+    });
+}
+
+// An object passed down a call chain of `kChainDepth` calls by `SharedPtr` value ("value")
+// against `SharedRef` ("borrowed")
+constexpr int kChainDepth = 8;
+
+template <typename Handle>
+[[gnu::noipa]] int64_t PassDown(Handle handle, int depth) {
+    if (depth == 0) {
+        return handle->value[0];
+    }
+    return PassDown<Handle>(handle, depth - 1) + 1;
+}
+
+void BorrowCase(Runner& runner) {
+    auto object = MakeShared<Payload>();
+    runner.Run("shared_call_chain", "value", 1, 5'000'000, [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            int64_t result = PassDown<SharedPtr<Payload>>(object, kChainDepth);
+            Escape(result);
+        }
+    });
+    runner.Run("shared_call_chain", "borrowed", 1, 5'000'000, [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            int64_t result = PassDown<SharedRef<Payload>>(object, kChainDepth);
+            Escape(result);
+        }
+    });
+}
+
+// Multi-megabyte buffers, value-initialized ("value") against default-initialized through
+// the `ForOverwrite` functions ("default"). Only the first byte is written, as if the rest
+// were filled by a read.
+constexpr size_t kBufferSize = 4 << 20;
+
+void BufferCases(Runner& runner) {
+    auto run = [&](const char* name, const char* impl, auto make) {
+        runner.Run(name, impl, 1, 2'000, [&](size_t iterations) {
+            for (size_t i = 0; i < iterations; ++i) {
+                auto buffer = make();
+                buffer[0] = 1;
+                Escape(buffer);
+            }
+        });
+    };
+    run("unique_buffer_4mb", "value", [] { return MakeUnique<char[]>(kBufferSize); });
+    run("unique_buffer_4mb", "default", [] { return MakeUniqueForOverwrite<char[]>(kBufferSize); });
+    run("shared_buffer_4mb", "value", [] { return MakeShared<char[]>(kBufferSize); });
+    run("shared_buffer_4mb", "default", [] { return MakeSharedForOverwrite<char[]>(kBufferSize); });
+}
+
+Options ParseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--json") {
+            options.json = true;
+        } else if (arg.rfind("--filter=", 0) == 0) {
+            options.filter = arg.substr(9);
+        } else if (arg.rfind("--threads=", 0) == 0) {
+            options.max_threads = std::max(1, std::atoi(arg.c_str() + 10));
+        } else if (arg.rfind("--scale=", 0) == 0) {
+            options.scale = std::atof(arg.c_str() + 8);
+        } else {
+            std::fprintf(stderr, "unknown option %s\n", arg.c_str());
+            std::exit(2);
+        }
+    }
+    return options;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Runner runner(ParseOptions(argc, argv));
+    runner.PrintHeader();
+    SharedCases<Sp>(runner, "sp");
+    SharedCases<Std>(runner, "std");
+    UniqueCases<Sp>(runner, "sp");
+    UniqueCases<Std>(runner, "std");
+    PolicyCase<AtomicCounting>(runner, "atomic");
+    PolicyCase<LocalCounting>(runner, "local");
+    PolicyCase<BiasedCounting>(runner, "biased");
+    PolicyCase<CompactCounting>(runner, "compact");
+    PoolCase(runner);
+    BorrowCase(runner);
+    BufferCases(runner);
+}
@@ -0,0 +1,61 @@
+// Owner-thread copy/release throughput of biased against atomic counting.
+//
+//     g++ -std=c++17 -O2 -I. bench/biased_counting.cpp -o biased_counting -pthread
+//
+// "owner" copies and releases in the creating thread only, "shared" adds a second thread
+// that copies the same object, so part of the references take the atomic path.
+
+#include "shared/biased.h"
+#include "shared/shared.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+namespace {
+
+constexpr int kIterations = 20'000'000;
+
+// Nanoseconds per copy and release of `object` in the calling thread
+template <typename Policy>
+double CopyLoop(const SharedPtr<int, Policy>& object) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kIterations; ++i) {
+        SharedPtr<int, Policy> copy(object);
+        asm volatile("" : : "r"(copy.Get()) : "memory");
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / kIterations;
+}
+
+template <typename Policy>
+double OwnerCopies() {
+    return CopyLoop(MakeSharedWithPolicy<int, Policy>(0));
+}
+
+template <typename Policy>
+double SharedCopies() {
+    auto object = MakeSharedWithPolicy<int, Policy>(0);
+    std::atomic<bool> done = false;
+    std::thread other([&done, copy = object] {
+        while (!done.load(std::memory_order_relaxed)) {
+            SharedPtr<int, Policy> local(copy);
+            asm volatile("" : : "r"(local.Get()) : "memory");
+        }
+    });
+    double result = CopyLoop(object);
+    done = true;
+    other.join();
+    return result;
+}
+
+}  // namespace
+
+int main() {
+    std::printf("%-8s %12s %12s\n", "case", "atomic ns", "biased ns");
+    std::printf("%-8s %12.2f %12.2f\n", "owner", OwnerCopies<AtomicCounting>(),
+                OwnerCopies<BiasedCounting>());
+    std::printf("%-8s %12.2f %12.2f\n", "shared", SharedCopies<AtomicCounting>(),
+                SharedCopies<BiasedCounting>());
+}
@@ -0,0 +1,82 @@
+// Size and code generation regression checks of `UniquePtr` against raw pointers.
+//
+//     bench/codegen.sh [compiler]
+//
+// The sizes are checked by the `static_assert`-s below when this file compiles. Every
+// `unique_<op>` function does with a `UniquePtr` what `raw_<op>` does with a raw pointer,
+// `codegen.sh` compiles the file at -O2 and fails if the two disassemble differently.
+
+#include "unique/unique.h"
+
+#include <utility>
+
+struct Object {
+    ~Object();
+};
+
+struct EmptyDeleter {
+    void operator()(Object* ptr) const {
+        delete ptr;
+    }
+};
+struct FinalDeleter final {
+    void operator()(Object* ptr) const {
+        delete ptr;
+    }
+};
+
+static_assert(sizeof(UniquePtr<Object>) == sizeof(Object*));
+static_assert(sizeof(UniquePtr<Object[]>) == sizeof(Object*));
+static_assert(sizeof(UniquePtr<Object, EmptyDeleter>) == sizeof(Object*));
+static_assert(sizeof(UniquePtr<Object, FinalDeleter>) == sizeof(Object*));
+static_assert(sizeof(CompressedPair<EmptyDeleter, EmptyDeleter>) == 1);
+static_assert(sizeof(CompressedPair<Object*, CompressedPair<EmptyDeleter, FinalDeleter>>) ==
+              sizeof(Object*));
+
+using Ptr = UniquePtr<Object>;
+
+extern "C" {
+
+void raw_move_construct(Object** from, Object** to) {
+    *to = std::exchange(*from, nullptr);
+}
+void unique_move_construct(Ptr* from, Ptr* to) {
+    new (to) Ptr(std::move(*from));
+}
+
+void raw_move_assign(Object** from, Object** to) {
+    Object* ptr = std::exchange(*from, nullptr);
+    delete std::exchange(*to, ptr);
+}
+void unique_move_assign(Ptr* from, Ptr* to) {
+    *to = std::move(*from);
+}
+
+void raw_swap(Object** left, Object** right) {
+    std::swap(*left, *right);
+}
+void unique_swap(Ptr* left, Ptr* right) {
+    left->Swap(*right);
+}
+
+Object* raw_release(Object** ptr) {
+    return std::exchange(*ptr, nullptr);
+}
+Object* unique_release(Ptr* ptr) {
+    return ptr->Release();
+}
+
+void raw_reset(Object** ptr, Object* value) {
+    delete std::exchange(*ptr, value);
+}
+void unique_reset(Ptr* ptr, Object* value) {
+    ptr->Reset(value);
+}
+
+void raw_destroy(Object** ptr) {
+    delete *ptr;
+}
+void unique_destroy(Ptr* ptr) {
+    ptr->~Ptr();
+}
+}
@@ -0,0 +1,34 @@
+#!/bin/sh
+# Compiles bench/codegen.cpp at -O2 and compares the disassembly of every `unique_<op>`
+# function with its `raw_<op>` counterpart. Run from the repository root.
+set -eu
+
+compiler=${1:-g++}
+object=$(mktemp)
+trap 'rm -f "$object"' EXIT
+
+"$compiler" -std=c++17 -O2 -I. -c bench/codegen.cpp -o "$object"
+
+# Instructions of one function without addresses and alignment padding, calls are kept
+# through their relocations
+body() {
+    objdump -d --no-show-raw-insn -r "$object" |
+        awk -v name="<$1>:" '$2 == name { found = 1; next } found && NF == 0 { exit }
+                            found { sub(/^[ \t]*[0-9a-f]+:[ \t]*/, ""); print }' |
+        sed -e 's/[0-9a-f]* <[^>]*>//' | grep -v -e '^nop' -e '^data16' -e '^xchg *%ax,%ax'
+}
+
+status=0
+for op in move_construct move_assign swap release reset destroy; do
+    if [ "$(body "raw_$op")" = "$(body "unique_$op")" ]; then
+        echo "same      $op"
+    else
+        echo "DIFFERENT $op"
+        body "raw_$op" > "$object.raw"
+        body "unique_$op" > "$object.unique"
+        diff "$object.raw" "$object.unique" || true
+        rm -f "$object.raw" "$object.unique"
+        status=1
+    fi
+done
+exit $status
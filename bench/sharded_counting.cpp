@@ -0,0 +1,79 @@
+// Scaling of copies of one shared object with atomic against sharded counting.
+//
+//     g++ -std=c++17 -O2 -I. bench/sharded_counting.cpp -o sharded_counting -pthread
+//     ./sharded_counting [max threads, 64 by default]
+//
+// Every thread copies and releases the same object in a loop. Reports nanoseconds per copy
+// and release as seen by one thread, and the total copies per microsecond of all threads.
+
+#include "shared/sharded.h"
+#include "shared/shared.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr int kIterations = 2'000'000;
+
+struct Result {
+    double ns_per_copy;
+    double copies_per_us;
+};
+
+// Copies and releases of the object `owner` hands out, from every thread
+template <typename Owner>
+Result Copies(const Owner& owner, size_t threads) {
+    std::atomic<size_t> ready = 0;
+    std::atomic<bool> go = false;
+    std::vector<std::thread> workers;
+    for (size_t worker = 0; worker < threads; ++worker) {
+        workers.emplace_back([&] {
+            ready.fetch_add(1);
+            while (!go.load(std::memory_order_acquire)) {
+            }
+            for (int i = 0; i < kIterations; ++i) {
+                auto copy = owner.Share();
+                asm volatile("" : : "r"(copy.Get()) : "memory");
+            }
+        });
+    }
+    while (ready.load() != threads) {
+    }
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    double copies = static_cast<double>(kIterations) * static_cast<double>(threads);
+    return {elapsed.count() / kIterations, copies / elapsed.count() * 1000.0};
+}
+
+// Hands out copies of an atomically counted object, like `ShardedOwner`
+struct AtomicOwner {
+    SharedPtr<int, AtomicCounting> Share() const {
+        return ptr;
+    }
+
+    SharedPtr<int, AtomicCounting> ptr = MakeSharedWithPolicy<int, AtomicCounting>(0);
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t max_threads = argc > 1 ? std::max(1, std::atoi(argv[1])) : 64;
+    std::printf("%-8s %12s %12s %14s %14s\n", "threads", "atomic ns", "sharded ns",
+                "atomic /us", "sharded /us");
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        Result atomic = Copies(AtomicOwner(), threads);
+        Result sharded = Copies(MakeSharded<int>(0), threads);
+        std::printf("%-8zu %12.2f %12.2f %14.1f %14.1f\n", threads, atomic.ns_per_copy,
+                    sharded.ns_per_copy, atomic.copies_per_us, sharded.copies_per_us);
+    }
+}
@@ -0,0 +1,249 @@
+#pragma once
+
+#include "../shared/shared.h"
+
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+// `IntrusivePtr<T>` finds the reference count of a `T` through two functions looked up by
+// argument-dependent lookup:
+//
+//     void IntrusivePtrAddRef(const T* ptr);
+//     void IntrusivePtrRelease(const T* ptr);  // destroys `*ptr` on the last release
+//
+// Deriving from `RefCounted<T, Policy>` provides both, for types that cannot be changed
+// they can be declared next to the type.
+
+// Single counter kept inside the object
+template <typename Policy>
+class IntrusiveCounter;
+
+template <>
+class IntrusiveCounter<LocalCounting> {
+public:
+    void Inc() {
+        ++count_;
+    }
+    size_t Dec() {
+        return --count_;
+    }
+    size_t Get() const {
+        return count_;
+    }
+
+private:
+    size_t count_ = 0;
+};
+
+template <>
+class IntrusiveCounter<AtomicCounting> {
+public:
+    void Inc() {
+        count_.fetch_add(1, std::memory_order_relaxed);
+    }
+    size_t Dec() {
+        size_t result = count_.fetch_sub(1, std::memory_order_release) - 1;
+        if (result == 0) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return result;
+    }
+    size_t Get() const {
+        return count_.load(std::memory_order_acquire);
+    }
+
+private:
+    std::atomic<size_t> count_ = 0;
+};
+
+template <typename T, typename Policy = DefaultCounting>
+class RefCounted {
+public:
+    size_t UseCount() const {
+        return count_.Get();
+    }
+
+protected:
+    RefCounted() = default;
+    // A copy is a new object nobody refers to yet
+    RefCounted(const RefCounted&) {
+    }
+    RefCounted& operator=(const RefCounted&) {
+        return *this;
+    }
+    ~RefCounted() = default;
+
+private:
+    friend void IntrusivePtrAddRef(const RefCounted* ptr) {
+        ptr->count_.Inc();
+    }
+    friend void IntrusivePtrRelease(const RefCounted* ptr) {
+        if (ptr->count_.Dec() == 0) {
+            delete static_cast<const T*>(ptr);
+        }
+    }
+
+    mutable IntrusiveCounter<Policy> count_;
+};
+
+// Owning pointer of the size of a raw pointer, the count lives in the object
+template <typename T>
+class IntrusivePtr {
+    template <typename Y>
+    friend class IntrusivePtr;
+
+public:
+    // Constructors
+
+    IntrusivePtr() : ptr_(nullptr) {
+    }
+    IntrusivePtr(std::nullptr_t) : ptr_(nullptr) {
+    }
+    // Takes a new reference, or adopts one the caller already holds if `add_ref` is false
+    IntrusivePtr(T* ptr, bool add_ref = true) : ptr_(ptr) {
+        if (ptr_ && add_ref) {
+            IntrusivePtrAddRef(ptr_);
+        }
+    }
+
+    IntrusivePtr(const IntrusivePtr& other) : IntrusivePtr(other.ptr_) {
+    }
+    IntrusivePtr(IntrusivePtr&& other) noexcept : ptr_(other.ptr_) {
+        other.ptr_ = nullptr;
+    }
+
+    template <typename Y>
+    IntrusivePtr(const IntrusivePtr<Y>& other) : IntrusivePtr(other.ptr_) {
+    }
+    template <typename Y>
+    IntrusivePtr(IntrusivePtr<Y>&& other) noexcept : ptr_(other.ptr_) {
+        other.ptr_ = nullptr;
+    }
+
+    // `operator=`-s
+
+    IntrusivePtr& operator=(const IntrusivePtr& other) {
+        IntrusivePtr(other).Swap(*this);
+        return *this;
+    }
+    IntrusivePtr& operator=(IntrusivePtr&& other) noexcept {
+        IntrusivePtr(std::move(other)).Swap(*this);
+        return *this;
+    }
+    template <typename Y>
+    IntrusivePtr& operator=(const IntrusivePtr<Y>& other) {
+        IntrusivePtr(other).Swap(*this);
+        return *this;
+    }
+    template <typename Y>
+    IntrusivePtr& operator=(IntrusivePtr<Y>&& other) noexcept {
+        IntrusivePtr(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    // Destructor
+
+    ~IntrusivePtr() {
+        if (ptr_) {
+            IntrusivePtrRelease(ptr_);
+        }
+    }
+
+    // Modifiers
+
+    void Reset() {
+        IntrusivePtr().Swap(*this);
+    }
+    void Reset(T* ptr, bool add_ref = true) {
+        IntrusivePtr(ptr, add_ref).Swap(*this);
+    }
+    // Gives up ownership without releasing the reference
+    T* Detach() {
+        T* result = ptr_;
+        ptr_ = nullptr;
+        return result;
+    }
+    void Swap(IntrusivePtr& other) noexcept {
+        std::swap(ptr_, other.ptr_);
+    }
+
+    // Observers
+
+    T* Get() const {
+        return ptr_;
+    }
+    T& operator*() const {
+        return *ptr_;
+    }
+    T* operator->() const {
+        return ptr_;
+    }
+    explicit operator bool() const {
+        return ptr_ != nullptr;
+    }
+
+private:
+    T* ptr_;
+};
+
+template <typename T>
+struct IsTriviallyRelocatable<IntrusivePtr<T>> : std::true_type {};
+
+template <typename T, typename U>
+inline bool operator==(const IntrusivePtr<T>& left, const IntrusivePtr<U>& right) {
+    return left.Get() == right.Get();
+}
+template <typename T, typename U>
+inline bool operator!=(const IntrusivePtr<T>& left, const IntrusivePtr<U>& right) {
+    return left.Get() != right.Get();
+}
+
+template <typename T, typename... Args>
+IntrusivePtr<T> MakeIntrusive(Args&&... args) {
+    return IntrusivePtr<T>(new T(std::forward<Args>(args)...));
+}
+
+// Casts, the rvalue overloads hand the reference over without touching the count
+
+template <typename T, typename U>
+IntrusivePtr<T> StaticPointerCast(const IntrusivePtr<U>& ptr) {
+    return IntrusivePtr<T>(static_cast<T*>(ptr.Get()));
+}
+template <typename T, typename U>
+IntrusivePtr<T> StaticPointerCast(IntrusivePtr<U>&& ptr) {
+    return IntrusivePtr<T>(static_cast<T*>(ptr.Detach()), false);
+}
+
+template <typename T, typename U>
+IntrusivePtr<T> ConstPointerCast(const IntrusivePtr<U>& ptr) {
+    return IntrusivePtr<T>(const_cast<T*>(ptr.Get()));
+}
+template <typename T, typename U>
+IntrusivePtr<T> ConstPointerCast(IntrusivePtr<U>&& ptr) {
+    return IntrusivePtr<T>(const_cast<T*>(ptr.Detach()), false);
+}
+
+template <typename T, typename U>
+IntrusivePtr<T> DynamicPointerCast(const IntrusivePtr<U>& ptr) {
+    return IntrusivePtr<T>(dynamic_cast<T*>(ptr.Get()));
+}
+template <typename T, typename U>
+IntrusivePtr<T> DynamicPointerCast(IntrusivePtr<U>&& ptr) {
+    if (T* result = dynamic_cast<T*>(ptr.Get())) {
+        ptr.Detach();
+        return IntrusivePtr<T>(result, false);
+    }
+    return IntrusivePtr<T>();
+}
+
+// Shares the object with `SharedPtr` code: the control block holds one intrusive reference,
+// so the aliasing constructor of `SharedPtr` can then point into the object
+template <typename T>
+SharedPtr<T> ToSharedPtr(IntrusivePtr<T> ptr) {
+    if (!ptr) {
+        return SharedPtr<T>();
+    }
+    return SharedPtr<T>(ptr.Detach(), [](T* object) { IntrusivePtrRelease(object); });
+}
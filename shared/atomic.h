@@ -0,0 +1,298 @@
+#pragma once
+
+#include "shared.h"
+#include "weak.h"
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <type_traits>
+
+// Split reference counting over an immutable heap node that holds the published pointer.
+// The atomic word packs the node address into the low 48 bits (user space addresses on
+// x86-64 and AArch64 with 4-level tables) and the number of readers currently copying out of
+// the node into the top 16. A reader announces itself with one `fetch_add` on the word,
+// copies the pointer and then either takes its announcement back from the word or, if a
+// writer has already swapped the node out, from the node's own counter. Readers therefore
+// never wait for writers.
+//
+// A node above 48 bits, possible with 5-level paging or 52-bit virtual addresses, or more
+// than `kReaderLimit` readers of one cell at the same time would corrupt the word. Both are
+// treated like running out of memory and terminate the program.
+template <typename Ptr>
+class SplitCountedCell {
+    static_assert(sizeof(uintptr_t) == 8, "split reference counting needs 64-bit pointers");
+
+    struct Node {
+        explicit Node(Ptr value) : value(std::move(value)) {
+        }
+
+        const Ptr value;
+        // Readers that still have to leave, minus those that already left
+        std::atomic<int64_t> internal = 0;
+    };
+
+    static constexpr int kCountShift = 48;
+    static constexpr uintptr_t kOneReader = uintptr_t(1) << kCountShift;
+    static constexpr uintptr_t kNodeMask = kOneReader - 1;
+
+public:
+    // Readers copying out of one cell at the same time, half of what the count holds
+    static constexpr uintptr_t kReaderLimit = uintptr_t(1) << (63 - kCountShift);
+
+    SplitCountedCell() : word_(0) {
+    }
+    explicit SplitCountedCell(Ptr value) : word_(Pack(MakeNode(std::move(value)))) {
+    }
+
+    SplitCountedCell(const SplitCountedCell&) = delete;
+    SplitCountedCell& operator=(const SplitCountedCell&) = delete;
+
+    ~SplitCountedCell() {
+        uintptr_t word = word_.load(std::memory_order_acquire);
+        if (Node* node = Unpack(word)) {
+            Retire(node, word);
+        }
+    }
+
+    Ptr Load() const {
+        uintptr_t word = word_.load(std::memory_order_acquire);
+        if (Unpack(word) == nullptr) {
+            return Ptr();
+        }
+        Node* node = Acquire();
+        if (node == nullptr) {
+            return Ptr();
+        }
+        Ptr result = node->value;
+        Leave(node);
+        return result;
+    }
+
+    Ptr Exchange(Ptr desired) {
+        uintptr_t word =
+            word_.exchange(Pack(MakeNode(std::move(desired))), std::memory_order_acq_rel);
+        Node* node = Unpack(word);
+        if (node == nullptr) {
+            return Ptr();
+        }
+        Ptr result = node->value;
+        Retire(node, word);
+        return result;
+    }
+
+    // On failure `expected` receives the current value
+    template <typename Equal>
+    bool CompareExchange(Ptr& expected, Ptr& desired, bool weak, Equal equal) {
+        while (true) {
+            Node* node = Acquire();
+            if (node == nullptr ? !equal(expected, Ptr()) : !equal(expected, node->value)) {
+                expected = node == nullptr ? Ptr() : node->value;
+                if (node) {
+                    Leave(node);
+                }
+                return false;
+            }
+            Node* replacement = MakeNode(desired);
+            uintptr_t word = word_.load(std::memory_order_relaxed);
+            bool swapped = false;
+            while (Unpack(word) == node) {
+                if (word_.compare_exchange_weak(word, Pack(replacement), std::memory_order_acq_rel,
+                                                std::memory_order_relaxed)) {
+                    swapped = true;
+                    break;
+                }
+            }
+            if (swapped) {
+                if (node) {
+                    // Our own announcement is still in `word`, it is taken back by `Leave`
+                    Retire(node, word);
+                    Leave(node);
+                }
+                return true;
+            }
+            delete replacement;
+            if (node) {
+                Leave(node);
+            }
+            if (weak) {
+                expected = Load();
+                return false;
+            }
+        }
+    }
+
+    static constexpr bool IsLockFree() {
+        return std::atomic<uintptr_t>::is_always_lock_free;
+    }
+
+private:
+    static Node* MakeNode(Ptr value) {
+        return new Node(std::move(value));
+    }
+    static uintptr_t Pack(Node* node) {
+        uintptr_t address = reinterpret_cast<uintptr_t>(node);
+        if ((address & ~kNodeMask) != 0) {
+            std::terminate();
+        }
+        return address;
+    }
+    static Node* Unpack(uintptr_t word) {
+        return reinterpret_cast<Node*>(word & kNodeMask);
+    }
+
+    // Announces a reader on the current node, the node stays alive until `Leave`
+    Node* Acquire() const {
+        uintptr_t word = word_.fetch_add(kOneReader, std::memory_order_acquire);
+        if ((word >> kCountShift) >= kReaderLimit) {
+            std::terminate();
+        }
+        Node* node = Unpack(word);
+        if (node == nullptr) {
+            Leave(nullptr);
+        }
+        return node;
+    }
+
+    void Leave(Node* node) const {
+        uintptr_t word = word_.load(std::memory_order_relaxed);
+        while (Unpack(word) == node) {
+            if (word_.compare_exchange_weak(word, word - kOneReader, std::memory_order_release,
+                                            std::memory_order_relaxed)) {
+                return;
+            }
+        }
+        if (node == nullptr) {
+            // An empty cell was replaced, nobody waits for its announcements
+            return;
+        }
+        // The node was swapped out and its announced readers were moved to `internal`
+        if (node->internal.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete node;
+        }
+    }
+
+    // Called once by the writer that swapped `node` out of the cell, `word` is the last
+    // value it had there
+    static void Retire(Node* node, uintptr_t word) {
+        int64_t readers = static_cast<int64_t>(word >> kCountShift);
+        if (node->internal.fetch_add(readers, std::memory_order_acq_rel) + readers == 0) {
+            delete node;
+        }
+    }
+
+    mutable std::atomic<uintptr_t> word_;
+};
+
+// Equivalent of `std::atomic<std::shared_ptr<T>>`
+template <typename T, typename Policy>
+class AtomicSharedPtr {
+    static_assert(!std::is_same_v<Policy, LocalCounting>,
+                  "AtomicSharedPtr needs thread-safe reference counting");
+
+public:
+    // Constructors
+
+    AtomicSharedPtr() = default;
+    AtomicSharedPtr(std::nullptr_t) {
+    }
+    AtomicSharedPtr(SharedPtr<T, Policy> desired) : cell_(std::move(desired)) {
+    }
+
+    AtomicSharedPtr(const AtomicSharedPtr&) = delete;
+    AtomicSharedPtr& operator=(const AtomicSharedPtr&) = delete;
+
+    // Operations
+
+    SharedPtr<T, Policy> Load() const {
+        return cell_.Load();
+    }
+    void Store(SharedPtr<T, Policy> desired) {
+        cell_.Exchange(std::move(desired));
+    }
+    SharedPtr<T, Policy> Exchange(SharedPtr<T, Policy> desired) {
+        return cell_.Exchange(std::move(desired));
+    }
+
+    bool CompareExchangeWeak(SharedPtr<T, Policy>& expected, SharedPtr<T, Policy> desired) {
+        return cell_.CompareExchange(expected, desired, true, Equal);
+    }
+    bool CompareExchangeStrong(SharedPtr<T, Policy>& expected, SharedPtr<T, Policy> desired) {
+        return cell_.CompareExchange(expected, desired, false, Equal);
+    }
+
+    operator SharedPtr<T, Policy>() const {
+        return Load();
+    }
+    AtomicSharedPtr& operator=(SharedPtr<T, Policy> desired) {
+        Store(std::move(desired));
+        return *this;
+    }
+
+    static constexpr bool IsLockFree() {
+        return SplitCountedCell<SharedPtr<T, Policy>>::IsLockFree();
+    }
+
+private:
+    // Same stored pointer and same ownership
+    static bool Equal(const SharedPtr<T, Policy>& left, const SharedPtr<T, Policy>& right) {
+        return left.ptr_ == right.ptr_ && left.block_ == right.block_;
+    }
+
+    SplitCountedCell<SharedPtr<T, Policy>> cell_;
+};
+
+// Equivalent of `std::atomic<std::weak_ptr<T>>`
+template <typename T, typename Policy>
+class AtomicWeakPtr {
+    static_assert(!std::is_same_v<Policy, LocalCounting>,
+                  "AtomicWeakPtr needs thread-safe reference counting");
+
+public:
+    // Constructors
+
+    AtomicWeakPtr() = default;
+    AtomicWeakPtr(WeakPtr<T, Policy> desired) : cell_(std::move(desired)) {
+    }
+
+    AtomicWeakPtr(const AtomicWeakPtr&) = delete;
+    AtomicWeakPtr& operator=(const AtomicWeakPtr&) = delete;
+
+    // Operations
+
+    WeakPtr<T, Policy> Load() const {
+        return cell_.Load();
+    }
+    void Store(WeakPtr<T, Policy> desired) {
+        cell_.Exchange(std::move(desired));
+    }
+    WeakPtr<T, Policy> Exchange(WeakPtr<T, Policy> desired) {
+        return cell_.Exchange(std::move(desired));
+    }
+
+    bool CompareExchangeWeak(WeakPtr<T, Policy>& expected, WeakPtr<T, Policy> desired) {
+        return cell_.CompareExchange(expected, desired, true, Equal);
+    }
+    bool CompareExchangeStrong(WeakPtr<T, Policy>& expected, WeakPtr<T, Policy> desired) {
+        return cell_.CompareExchange(expected, desired, false, Equal);
+    }
+
+    operator WeakPtr<T, Policy>() const {
+        return Load();
+    }
+    AtomicWeakPtr& operator=(WeakPtr<T, Policy> desired) {
+        Store(std::move(desired));
+        return *this;
+    }
+
+    static constexpr bool IsLockFree() {
+        return SplitCountedCell<WeakPtr<T, Policy>>::IsLockFree();
+    }
+
+private:
+    static bool Equal(const WeakPtr<T, Policy>& left, const WeakPtr<T, Policy>& right) {
+        return left.ptr_ == right.ptr_ && left.block_ == right.block_;
+    }
+
+    SplitCountedCell<WeakPtr<T, Policy>> cell_;
+};
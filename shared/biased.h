@@ -0,0 +1,310 @@
+#pragma once
+
+#include "shared.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Biased reference counting for objects that are created and copied mostly by one thread.
+//
+// The thread that creates the block owns it and counts its own references in a counter that
+// only it writes, so its copies and releases are plain loads and stores. Other threads count
+// in a shared atomic word, which may go below zero while the owner still holds references.
+// The two counts are merged into the shared word once the owner drops its last reference;
+// from then on every thread uses the shared word and the last decrement destroys the object.
+//
+// A thread that would take the shared count below zero before the merge hands its reference
+// to the owner instead: the block is queued to the owner, which merges it and drops that
+// reference on its next release of a biased block or when it exits. If the owner has already
+// exited, its biased count can no longer change and the queuing thread merges it itself. Use
+// `DrainBiasedQueue()` in owner threads that stop releasing pointers for long periods.
+class BiasedCounting {
+    // The shared word holds the count in steps of `kOne` above two flags
+    static constexpr int64_t kMerged = 1;
+    static constexpr int64_t kQueued = 2;
+    static constexpr int64_t kFlags = kMerged | kQueued;
+    static constexpr int64_t kOne = 4;
+
+    // Thread ids are never reused. `kNoOwner` marks merged blocks, `kThreadGone` threads
+    // whose queue is already destroyed.
+    static constexpr uint64_t kNoThread = 0;
+    static constexpr uint64_t kThreadGone = UINT64_MAX - 1;
+    static constexpr uint64_t kNoOwner = UINT64_MAX;
+
+public:
+    using Block = ControlBlockBase<BiasedCounting>;
+
+    BiasedCounting() : owner_(RegisterThread()) {
+        if (owner_ == kNoOwner) {
+            // Blocks made while the thread is being torn down start merged
+            biased_.store(0, std::memory_order_relaxed);
+            shared_.store(kOne | kMerged, std::memory_order_relaxed);
+        }
+    }
+
+    BiasedCounting(const BiasedCounting&) = delete;
+    BiasedCounting& operator=(const BiasedCounting&) = delete;
+
+    void Bind(Block* block) {
+        block_ = block;
+    }
+
+    void IncStrong() {
+        if (IsBiased()) {
+            biased_.store(biased_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        } else {
+            shared_.fetch_add(kOne, std::memory_order_relaxed);
+        }
+    }
+    size_t DecStrong() {
+        if (IsBiased()) {
+            DrainBiasedQueue();
+        }
+        if (IsBiased()) {
+            size_t biased = biased_.load(std::memory_order_relaxed) - 1;
+            biased_.store(biased, std::memory_order_relaxed);
+            return biased == 0 ? Merge() : biased;
+        }
+        int64_t word = shared_.load(std::memory_order_relaxed);
+        while ((word & kMerged) == 0) {
+            if (Count(word) > 0 || (word & kQueued) != 0) {
+                // Either this reference was counted here, or the queued one keeps the
+                // object alive until the owner merges
+                if (shared_.compare_exchange_weak(word, word - kOne, std::memory_order_release,
+                                                  std::memory_order_relaxed)) {
+                    return 1;
+                }
+            } else if (shared_.compare_exchange_weak(word, word | kQueued,
+                                                     std::memory_order_relaxed,
+                                                     std::memory_order_relaxed)) {
+                if (HandToOwner(this)) {
+                    return 1;
+                }
+                // The owner is gone and the counts are merged, release as usual
+                break;
+            }
+        }
+        int64_t result = Count(shared_.fetch_sub(kOne, std::memory_order_release)) - 1;
+        if (result == 0) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return static_cast<size_t>(result);
+    }
+    void AddStrong(size_t count) {
+        if (IsBiased()) {
+            biased_.store(biased_.load(std::memory_order_relaxed) + count,
+                          std::memory_order_relaxed);
+        } else {
+            shared_.fetch_add(static_cast<int64_t>(count) * kOne, std::memory_order_relaxed);
+        }
+    }
+    size_t SubStrong(size_t count) {
+        if (IsBiased()) {
+            DrainBiasedQueue();
+        }
+        if (IsBiased()) {
+            size_t biased = biased_.load(std::memory_order_relaxed);
+            if (count < biased) {
+                biased_.store(biased - count, std::memory_order_relaxed);
+                return biased - count;
+            }
+            // The owner held fewer biased references than it drops, merge and take the rest
+            // from the shared word
+            biased_.store(0, std::memory_order_relaxed);
+            count -= biased;
+            size_t merged = Merge();
+            if (count == 0) {
+                return merged;
+            }
+        }
+        if ((shared_.load(std::memory_order_relaxed) & kMerged) == 0) {
+            // May hand references to the owner, one at a time as in `DecStrong`
+            for (; count > 1; --count) {
+                DecStrong();
+            }
+            return DecStrong();
+        }
+        int64_t result =
+            Count(shared_.fetch_sub(static_cast<int64_t>(count) * kOne,
+                                    std::memory_order_release)) -
+            static_cast<int64_t>(count);
+        if (result == 0) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return static_cast<size_t>(result);
+    }
+    // Until the merge the owner holds a reference, so only merged blocks can be dead
+    bool IncStrongIfNonZero() {
+        if (IsBiased()) {
+            IncStrong();
+            return true;
+        }
+        int64_t word = shared_.load(std::memory_order_relaxed);
+        while ((word & kMerged) == 0 || Count(word) != 0) {
+            if (shared_.compare_exchange_weak(word, word + kOne, std::memory_order_acq_rel,
+                                              std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    // Exact in the owner thread and for merged blocks, a snapshot elsewhere
+    size_t GetStrong() const {
+        int64_t word = shared_.load(std::memory_order_acquire);
+        int64_t count = Count(word);
+        if ((word & kMerged) == 0) {
+            count += static_cast<int64_t>(biased_.load(std::memory_order_relaxed));
+        }
+        return count > 0 ? static_cast<size_t>(count) : 0;
+    }
+
+    void IncWeak() {
+        weak_.fetch_add(1, std::memory_order_relaxed);
+    }
+    size_t DecWeak() {
+        size_t result = weak_.fetch_sub(1, std::memory_order_release) - 1;
+        if (result == 0) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return result;
+    }
+    size_t GetWeak() const {
+        return weak_.load(std::memory_order_acquire);
+    }
+
+    // Merges the blocks other threads queued to the calling thread and drops the references
+    // they handed over
+    static void DrainBiasedQueue() {
+        if (thread_id == kNoThread || thread_id == kThreadGone) {
+            return;
+        }
+        ThreadQueue& queue = Queue();
+        if (!queue.pending.load(std::memory_order_relaxed)) {
+            return;
+        }
+        std::vector<BiasedCounting*> blocks;
+        {
+            std::lock_guard<std::mutex> lock(RegistryMutex());
+            blocks.swap(queue.blocks);
+            queue.pending.store(false, std::memory_order_relaxed);
+        }
+        ReleaseQueued(blocks);
+    }
+
+private:
+    // Blocks queued to one owner thread, reachable by id through the registry
+    struct ThreadQueue {
+        ThreadQueue() {
+            static std::atomic<uint64_t> next_id = 1;
+            thread_id = next_id.fetch_add(1, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(RegistryMutex());
+            Registry().emplace(thread_id, this);
+        }
+
+        // Biased counts of the thread are frozen from here on, its later releases go to the
+        // shared words and other threads merge instead of queuing
+        ~ThreadQueue() {
+            uint64_t id = thread_id;
+            thread_id = kThreadGone;
+            std::vector<BiasedCounting*> left;
+            {
+                std::lock_guard<std::mutex> lock(RegistryMutex());
+                Registry().erase(id);
+                left.swap(blocks);
+            }
+            ReleaseQueued(left);
+        }
+
+        std::atomic<bool> pending = false;
+        std::vector<BiasedCounting*> blocks;
+    };
+
+    static int64_t Count(int64_t word) {
+        return (word - (word & kFlags)) / kOne;
+    }
+
+    bool IsBiased() const {
+        return owner_.load(std::memory_order_relaxed) == thread_id;
+    }
+
+    // Folds the biased count into the shared word and returns the merged count. Only the
+    // owner, or any thread after the owner has exited, may merge.
+    size_t Merge() {
+        int64_t biased = static_cast<int64_t>(biased_.load(std::memory_order_relaxed));
+        int64_t word = shared_.load(std::memory_order_acquire);
+        do {
+            if ((word & kMerged) != 0) {
+                return static_cast<size_t>(Count(word));
+            }
+        } while (!shared_.compare_exchange_weak(word, (word + biased * kOne) | kMerged,
+                                                std::memory_order_acq_rel,
+                                                std::memory_order_acquire));
+        biased_.store(0, std::memory_order_relaxed);
+        owner_.store(kNoOwner, std::memory_order_release);
+        return static_cast<size_t>(Count(word) + biased);
+    }
+
+    // Queues `counts` with the caller's reference to its owner. Returns false if the owner
+    // has exited, in which case the counts were merged here and the caller still holds its
+    // reference.
+    static bool HandToOwner(BiasedCounting* counts) {
+        std::unique_lock<std::mutex> lock(RegistryMutex());
+        // Not finding the owner also covers a merge that raced with the caller
+        auto it = Registry().find(counts->owner_.load(std::memory_order_acquire));
+        if (it == Registry().end()) {
+            lock.unlock();
+            counts->Merge();
+            return false;
+        }
+        it->second->blocks.push_back(counts);
+        it->second->pending.store(true, std::memory_order_relaxed);
+        return true;
+    }
+
+    // The queuing thread recorded the release in the statistics
+    static void ReleaseQueued(const std::vector<BiasedCounting*>& blocks) {
+        for (BiasedCounting* counts : blocks) {
+            counts->Merge();
+            counts->block_->ReleaseHanded();
+        }
+    }
+
+    static uint64_t RegisterThread() {
+        if (thread_id == kNoThread) {
+            Queue();
+        }
+        return thread_id == kThreadGone ? kNoOwner : thread_id;
+    }
+
+    static ThreadQueue& Queue() {
+        thread_local ThreadQueue queue;
+        return queue;
+    }
+    static std::mutex& RegistryMutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+    static std::unordered_map<uint64_t, ThreadQueue*>& Registry() {
+        static std::unordered_map<uint64_t, ThreadQueue*> registry;
+        return registry;
+    }
+
+    // Id of the calling thread once it has created a biased block
+    static inline thread_local uint64_t thread_id = kNoThread;
+
+    std::atomic<uint64_t> owner_;
+    std::atomic<size_t> biased_ = 1;
+    std::atomic<int64_t> shared_ = 0;
+    std::atomic<size_t> weak_ = 1;
+    Block* block_ = nullptr;
+};
+
+// Drains the calling thread's queue of biased blocks, see `BiasedCounting`
+inline void DrainBiasedQueue() {
+    BiasedCounting::DrainBiasedQueue();
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <unordered_map>
+
+// Define SMART_POINTERS_CHECK_BORROWS to check that `SharedRef`-s do not outlive the
+// `SharedPtr`-s they borrow from. Checked handles register with their source and hold a weak
+// reference, so they are no longer free to copy, and every reset of a `SharedPtr` looks its
+// address up. Meant for debug builds.
+#ifdef SMART_POINTERS_CHECK_BORROWS
+inline constexpr bool kBorrowChecksEnabled = true;
+#else
+inline constexpr bool kBorrowChecksEnabled = false;
+#endif
+
+// Number of live checked handles per source pointer. A source that is reset, reassigned,
+// moved from or destroyed while it is borrowed terminates the program.
+class BorrowRegistry {
+public:
+    static void Borrow(const void* source) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++counts[source];
+        borrows.fetch_add(1, std::memory_order_relaxed);
+    }
+    static void Return(const void* source) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = counts.find(source);
+        if (--it->second == 0) {
+            counts.erase(it);
+        }
+        borrows.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    static void CheckNotBorrowed(const void* source) {
+        // A handle borrowing from `source` is made before any change of it, by the same
+        // thread or with synchronization
+        if (borrows.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (counts.count(source) != 0) {
+            std::terminate();
+        }
+    }
+
+private:
+    static inline std::mutex mutex;
+    static inline std::unordered_map<const void*, size_t> counts;
+    static inline std::atomic<size_t> borrows = 0;
+};
@@ -0,0 +1,311 @@
+#pragma once
+
+#include "sw_fwd.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Passed to `TraceRefs` of objects that opt in to cycle collection, see `kTraceable`
+template <typename Policy>
+class CycleTracer {
+    using Block = ControlBlockBase<Policy>;
+
+    friend class CycleCollector<Policy>;
+
+public:
+    CycleTracer(const CycleTracer&) = delete;
+    CycleTracer& operator=(const CycleTracer&) = delete;
+
+    template <typename T>
+    void operator()(SharedPtr<T, Policy>& ptr) {
+        if (!ptr.block_) {
+            return;
+        }
+        blocks_.push_back(ptr.block_);
+        if (take_) {
+            ptr.block_ = nullptr;
+            ptr.ptr_ = nullptr;
+        }
+    }
+
+private:
+    // Appends the traced blocks to `blocks`. With `take` the pointers are emptied and their
+    // references handed to the caller through `blocks`.
+    CycleTracer(std::vector<Block*>& blocks, bool take) : blocks_(blocks), take_(take) {
+    }
+
+    std::vector<Block*>& blocks_;
+    bool take_;
+};
+
+// Collector of `SharedPtr` cycles by synchronous trial deletion (Bacon and Rajan, "Concurrent
+// Cycle Collection in Reference Counted Systems").
+//
+// A decrement that leaves a traceable block alive records it as a candidate root, holding a
+// weak reference so the block stays readable until the next step. A collection step
+// subtracts the references that candidates' subgraphs hold among themselves from copies of
+// their counts; blocks left with no references from outside the subgraph are garbage. Their
+// objects are cleared by taking the traced `SharedPtr`-s out of them and releasing those,
+// after which the ordinary release path destroys them, so destructors and weak pointers
+// behave as usual.
+//
+// Counts are read as they are, so a step must not run while other threads copy or release
+// the pointers reachable from the candidates. Recording candidates is thread-safe: every
+// thread buffers its candidates and hands them to the collector in batches of `kBatchSize`,
+// so decrements only take the collector's lock once per batch. A step sees the candidates
+// of the calling thread and the batches handed over before; other threads hand over the
+// rest with `FlushCycleCandidates()` or when they exit.
+template <typename Policy>
+class CycleCollector {
+    using Block = ControlBlockBase<Policy>;
+
+public:
+    static constexpr size_t kBatchSize = 64;
+
+    // Adopts a weak reference to `block`, dropped again if the block is already recorded
+    static void AddCandidate(Block* block) {
+        if (buffer_gone) {
+            Record(&block, 1);
+            return;
+        }
+        std::vector<Block*>& buffer = Buffer().blocks;
+        // Repeated decrements of one block need one candidate
+        if (!buffer.empty() && buffer.back() == block) {
+            block->ReleaseCandidate();
+            return;
+        }
+        buffer.push_back(block);
+        if (buffer.size() >= kBatchSize) {
+            FlushCandidates();
+        }
+    }
+
+    // Hands the candidates buffered by the calling thread to the collector
+    static void FlushCandidates() {
+        if (buffer_gone) {
+            return;
+        }
+        std::vector<Block*>& buffer = Buffer().blocks;
+        if (!buffer.empty()) {
+            Record(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+    }
+
+    // Takes candidates in the order they were recorded until `budget` blocks are traced,
+    // the step may exceed it by the subgraph of the last candidate. Returns the number of
+    // objects collected.
+    static size_t Collect(size_t budget) {
+        FlushCandidates();
+        Step step;
+        std::vector<Block*> taken;
+        while (step.Traced() < budget) {
+            Block* root = TakeRoot();
+            if (root == nullptr) {
+                break;
+            }
+            taken.push_back(root);
+            // Dead candidates were released after being recorded
+            if (root->GetCounter() != 0) {
+                step.MarkGray(root);
+            }
+        }
+        for (Block* root : taken) {
+            step.Scan(root);
+        }
+        size_t collected = step.ReleaseWhite();
+        for (Block* root : taken) {
+            root->ReleaseCandidate();
+        }
+        return collected;
+    }
+
+    // Candidates handed over to the collector
+    static size_t CandidateCount() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return roots.size();
+    }
+
+private:
+    // Trial deletion state of the blocks traced by one step
+    class Step {
+    public:
+        size_t Traced() const {
+            return state_.size();
+        }
+
+        // Subtracts the references held inside the subgraph of `root`
+        void MarkGray(Block* root) {
+            Entry& entry = Visit(root);
+            if (entry.color == kGray) {
+                return;
+            }
+            entry.color = kGray;
+            std::vector<Block*> edges;
+            Trace(root, edges);
+            while (!edges.empty()) {
+                Block* block = edges.back();
+                edges.pop_back();
+                Entry& target = Visit(block);
+                --target.count;
+                if (target.color != kGray) {
+                    target.color = kGray;
+                    Trace(block, edges);
+                }
+            }
+        }
+
+        // Blocks still referenced from outside and everything they reach stay alive, the
+        // rest of the subgraph becomes white
+        void Scan(Block* root) {
+            auto it = state_.find(root);
+            if (it == state_.end() || it->second.color != kGray) {
+                return;
+            }
+            std::vector<Block*> pending = {root};
+            while (!pending.empty()) {
+                Block* block = pending.back();
+                pending.pop_back();
+                Entry& entry = state_.at(block);
+                if (entry.color != kGray) {
+                    continue;
+                }
+                if (entry.count > 0) {
+                    ScanBlack(block);
+                } else {
+                    entry.color = kWhite;
+                    Trace(block, pending);
+                }
+            }
+        }
+
+        // Takes the traced references out of the white objects and drops them, the last
+        // drop of every white block destroys it
+        size_t ReleaseWhite() {
+            std::vector<Block*> references;
+            CycleTracer<Policy> tracer(references, true);
+            size_t collected = 0;
+            for (auto& [block, entry] : state_) {
+                if (entry.color == kWhite) {
+                    block->Trace(tracer);
+                    ++collected;
+                }
+            }
+            for (Block* block : references) {
+                block->DecCounter();
+            }
+            return collected;
+        }
+
+    private:
+        enum Color { kBlack, kGray, kWhite };
+
+        struct Entry {
+            // References not accounted for by the traced subgraph
+            std::ptrdiff_t count;
+            Color color;
+        };
+
+        Entry& Visit(Block* block) {
+            auto [it, inserted] = state_.try_emplace(block);
+            if (inserted) {
+                it->second = {static_cast<std::ptrdiff_t>(block->GetCounter()), kBlack};
+            }
+            return it->second;
+        }
+
+        void ScanBlack(Block* root) {
+            state_.at(root).color = kBlack;
+            std::vector<Block*> edges;
+            Trace(root, edges);
+            while (!edges.empty()) {
+                Block* block = edges.back();
+                edges.pop_back();
+                Entry& target = state_.at(block);
+                ++target.count;
+                if (target.color != kBlack) {
+                    target.color = kBlack;
+                    Trace(block, edges);
+                }
+            }
+        }
+
+        static void Trace(Block* block, std::vector<Block*>& edges) {
+            CycleTracer<Policy> tracer(edges, false);
+            block->Trace(tracer);
+        }
+
+        std::unordered_map<Block*, Entry> state_;
+    };
+
+    // Candidates recorded by one thread and not handed over yet
+    struct ThreadBuffer {
+        ~ThreadBuffer() {
+            Record(blocks.data(), blocks.size());
+            buffer_gone = true;
+        }
+
+        std::vector<Block*> blocks;
+    };
+
+    // Blocks recorded already drop the weak reference of the new candidate
+    static void Record(Block* const* blocks, size_t count) {
+        std::vector<Block*> duplicates;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t i = 0; i < count; ++i) {
+                if (buffered.insert(blocks[i]).second) {
+                    roots.push_back(blocks[i]);
+                } else {
+                    duplicates.push_back(blocks[i]);
+                }
+            }
+        }
+        for (Block* block : duplicates) {
+            block->ReleaseCandidate();
+        }
+    }
+
+    static ThreadBuffer& Buffer() {
+        thread_local ThreadBuffer buffer;
+        return buffer;
+    }
+
+    static Block* TakeRoot() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (roots.empty()) {
+            return nullptr;
+        }
+        Block* root = roots.front();
+        roots.pop_front();
+        buffered.erase(root);
+        return root;
+    }
+
+    // Set once the calling thread's buffer is destroyed, candidates recorded by later
+    // thread_local destructors go straight to the collector
+    static inline thread_local bool buffer_gone = false;
+
+    static inline std::mutex mutex;
+    static inline std::deque<Block*> roots;
+    static inline std::unordered_set<Block*> buffered;
+};
+
+// Runs one collection step over the candidates of `Policy` blocks, see `CycleCollector`.
+// Without SMART_POINTERS_CYCLE_COLLECTOR no candidates are recorded and nothing is collected.
+template <typename Policy = DefaultCounting>
+size_t CollectCycles(size_t budget = SIZE_MAX) {
+    return CycleCollector<Policy>::Collect(budget);
+}
+
+// Hands the cycle candidates the calling thread recorded to the collector, see
+// `CycleCollector`
+template <typename Policy = DefaultCounting>
+void FlushCycleCandidates() {
+    CycleCollector<Policy>::FlushCandidates();
+}
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+struct DeferredStats {
+    size_t deferred = 0;        // releases pushed onto the queue
+    size_t reclaimed = 0;       // of them finished by a drain
+    uint64_t last_lag_ns = 0;   // time the last reclaimed block spent in the queue
+    uint64_t max_lag_ns = 0;    // longest such time so far
+    uint64_t total_lag_ns = 0;  // sum over all reclaimed blocks
+
+    size_t Depth() const {
+        return deferred - reclaimed;
+    }
+    double MeanLagNs() const {
+        return reclaimed == 0 ? 0.0
+                              : static_cast<double>(total_lag_ns) / static_cast<double>(reclaimed);
+    }
+};
+
+// Define SMART_POINTERS_DEFERRED_RELEASE to let threads defer the destruction of objects
+// whose last reference they drop. Every thread-safe control block then carries a
+// `DeferredNode`. Without it the blocks never check for deferral and the functions and
+// classes below `DeferredRelease` are left out.
+#ifdef SMART_POINTERS_DEFERRED_RELEASE
+inline constexpr bool kDeferredReleaseEnabled = true;
+#else
+inline constexpr bool kDeferredReleaseEnabled = false;
+#endif
+
+// Queue link embedded in the control blocks, so deferring a release never allocates
+struct DeferredNode {
+    DeferredNode* next;
+    void (*finish)(DeferredNode*);
+    uint64_t pushed_ns;
+};
+
+// Deferred destruction of objects whose last reference is dropped on a latency-critical path.
+//
+// While a thread has release deferred, the last `DecCounter` of a block does not run the
+// destructor but pushes the block onto a lock-free stack. `DrainDeferred()` or a
+// `DeferredReclaimer` thread pops everything pushed so far and finishes the release there, in
+// push order, with deferral switched off so destructor cascades run inline. Weak pointers see
+// a deferred object as expired right away.
+//
+// Blocks with `LocalCounting` are confined to the threads that use them and are never
+// deferred, their last release destroys the object inside a scope too.
+class DeferredRelease {
+public:
+    using Finish = void (*)(DeferredNode*);
+
+    static bool Active() {
+        return active;
+    }
+    static void SetActive(bool value) {
+        active = value;
+    }
+
+    // `finish(node)` completes the release, the node is not touched after it
+    static void Push(DeferredNode* node, Finish finish) {
+        // Counted first so that the depth never goes below zero
+        deferred.fetch_add(1, std::memory_order_relaxed);
+        node->finish = finish;
+        node->pushed_ns = Now();
+        node->next = head.load(std::memory_order_relaxed);
+        while (!head.compare_exchange_weak(node->next, node, std::memory_order_release,
+                                           std::memory_order_relaxed)) {
+        }
+    }
+
+    // Finishes every release pushed before the call, returns how many there were
+    static size_t Drain() {
+        DeferredNode* node = head.exchange(nullptr, std::memory_order_acquire);
+        if (node == nullptr) {
+            return 0;
+        }
+        // The stack holds the newest push first
+        DeferredNode* ordered = nullptr;
+        while (node != nullptr) {
+            DeferredNode* next = node->next;
+            node->next = ordered;
+            ordered = node;
+            node = next;
+        }
+        bool was_active = active;
+        active = false;
+        size_t count = 0;
+        while (ordered != nullptr) {
+            // Finishing may free the node
+            DeferredNode* next = ordered->next;
+            uint64_t pushed_ns = ordered->pushed_ns;
+            ordered->finish(ordered);
+            RecordLag(Now() - pushed_ns);
+            ordered = next;
+            ++count;
+        }
+        active = was_active;
+        reclaimed.fetch_add(count, std::memory_order_relaxed);
+        return count;
+    }
+
+    static DeferredStats GetStats() {
+        DeferredStats stats;
+        stats.reclaimed = reclaimed.load(std::memory_order_relaxed);
+        stats.deferred = deferred.load(std::memory_order_relaxed);
+        stats.last_lag_ns = last_lag_ns.load(std::memory_order_relaxed);
+        stats.max_lag_ns = max_lag_ns.load(std::memory_order_relaxed);
+        stats.total_lag_ns = total_lag_ns.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    static uint64_t Now() {
+        auto since_epoch = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch).count();
+    }
+
+    static void RecordLag(uint64_t lag) {
+        last_lag_ns.store(lag, std::memory_order_relaxed);
+        total_lag_ns.fetch_add(lag, std::memory_order_relaxed);
+        uint64_t max = max_lag_ns.load(std::memory_order_relaxed);
+        while (lag > max &&
+               !max_lag_ns.compare_exchange_weak(max, lag, std::memory_order_relaxed)) {
+        }
+    }
+
+    static inline thread_local bool active = false;
+
+    static inline std::atomic<DeferredNode*> head = nullptr;
+    static inline std::atomic<size_t> deferred = 0;
+    static inline std::atomic<size_t> reclaimed = 0;
+    static inline std::atomic<uint64_t> last_lag_ns = 0;
+    static inline std::atomic<uint64_t> max_lag_ns = 0;
+    static inline std::atomic<uint64_t> total_lag_ns = 0;
+};
+
+#ifdef SMART_POINTERS_DEFERRED_RELEASE
+
+// Defers the last releases made by the current thread until the scope ends, scopes nest
+class DeferredReleaseScope {
+public:
+    DeferredReleaseScope() : was_active_(DeferredRelease::Active()) {
+        DeferredRelease::SetActive(true);
+    }
+    ~DeferredReleaseScope() {
+        DeferredRelease::SetActive(was_active_);
+    }
+
+    DeferredReleaseScope(const DeferredReleaseScope&) = delete;
+    DeferredReleaseScope& operator=(const DeferredReleaseScope&) = delete;
+
+private:
+    bool was_active_;
+};
+
+// Drops the reference held by `ptr`, deferring destruction if it was the last one
+template <typename Ptr>
+void ReleaseDeferred(Ptr& ptr) {
+    DeferredReleaseScope scope;
+    ptr.Reset();
+}
+
+inline size_t DrainDeferred() {
+    return DeferredRelease::Drain();
+}
+
+inline DeferredStats GetDeferredStats() {
+    return DeferredRelease::GetStats();
+}
+
+// Background thread that drains the deferred releases every `interval`, and once more when
+// it is destroyed
+class DeferredReclaimer {
+public:
+    explicit DeferredReclaimer(std::chrono::microseconds interval = std::chrono::milliseconds(1))
+        : interval_(interval), thread_([this] { Run(); }) {
+    }
+    ~DeferredReclaimer() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+    }
+
+    DeferredReclaimer(const DeferredReclaimer&) = delete;
+    DeferredReclaimer& operator=(const DeferredReclaimer&) = delete;
+
+private:
+    void Run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stop_) {
+            lock.unlock();
+            DeferredRelease::Drain();
+            lock.lock();
+            wake_.wait_for(lock, interval_, [this] { return stop_; });
+        }
+        lock.unlock();
+        DeferredRelease::Drain();
+    }
+
+    std::chrono::microseconds interval_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+#endif
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+
+// Comparators that key `SharedPtr` and `WeakPtr` on their control block, like
+// `std::owner_less`. Pointers of different element types compare too, and weak pointers
+// keep their place after the object expired.
+
+struct OwnerLess {
+    using is_transparent = void;
+
+    template <typename A, typename B>
+    bool operator()(const A& left, const B& right) const {
+        return left.OwnerBefore(right);
+    }
+};
+
+struct OwnerEqual {
+    using is_transparent = void;
+
+    template <typename A, typename B>
+    bool operator()(const A& left, const B& right) const {
+        return left.OwnerEquals(right);
+    }
+};
+
+struct OwnerHash {
+    using is_transparent = void;
+
+    template <typename A>
+    size_t operator()(const A& ptr) const {
+        return ptr.OwnerHash();
+    }
+};
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <new>
+
+struct PoolStats {
+    size_t hits = 0;        // allocations served from a thread cache
+    size_t misses = 0;      // allocations that refilled a thread cache first
+    size_t frees = 0;       // blocks returned to the pool
+    size_t slab_bytes = 0;  // memory the pool took from the system
+
+    size_t LiveBlocks() const {
+        return hits + misses - frees;
+    }
+    double HitRate() const {
+        size_t total = hits + misses;
+        return total == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(total);
+    }
+};
+
+// Size-class slab pool.
+//
+// Blocks up to `kMaxSize` bytes and aligned to at most `kAlignment` are rounded up to a
+// multiple of `kGranularity` and served from per-thread free lists without any
+// synchronization. A thread cache that runs dry takes a batch of blocks from the class's
+// central list, one that grows too large hands a batch back, and a finished thread returns
+// everything. A batch is `kBatchSize` blocks and at most `kBatchBytes` bytes, but at least
+// one block, so a thread never holds more than two batches of large blocks. Only these batch
+// moves take the per-class lock. Slabs are carved in address order, so blocks allocated one
+// after another are neighbours in memory. Memory is never returned to the system.
+//
+// Counters are kept per thread and published on every batch move, so `GetStats` may lag
+// behind by up to one batch per thread. Every instantiation is a separate pool.
+template <size_t kGranularity, size_t kMaxSize, size_t kAlignment = kGranularity>
+class SlabPool {
+    struct FreeNode {
+        FreeNode* next;
+    };
+
+    static_assert(kGranularity >= sizeof(FreeNode) && kGranularity % alignof(FreeNode) == 0,
+                  "blocks must hold a free list link");
+    static_assert(kGranularity % kAlignment == 0, "block sizes must keep the alignment");
+
+public:
+    static constexpr size_t kClassCount = kMaxSize / kGranularity;
+    static constexpr size_t kBatchSize = 32;
+    static constexpr size_t kBatchBytes = 8 * 1024;
+    static constexpr size_t kSlabSize = 64 * 1024;
+
+    // Blocks of the class moved between a thread cache and the central list at once
+    static constexpr size_t BatchSize(size_t index) {
+        size_t blocks = kBatchBytes / BlockSize(index);
+        return blocks == 0 ? 1 : blocks < kBatchSize ? blocks : kBatchSize;
+    }
+
+    static void* Allocate(size_t size, size_t alignment) {
+        if (!IsPooled(size, alignment)) {
+            return ::operator new(size, std::align_val_t(alignment));
+        }
+        size_t index = ClassIndex(size);
+        if (cache_gone) {
+            misses.fetch_add(1, std::memory_order_relaxed);
+            return Central(index).Pop(index);
+        }
+        ThreadCache& cache = Cache();
+        if (cache.lists[index] == nullptr) {
+            ++cache.misses;
+            cache.Refill(index);
+        } else {
+            ++cache.hits;
+        }
+        FreeNode* node = cache.lists[index];
+        cache.lists[index] = node->next;
+        --cache.counts[index];
+        return node;
+    }
+
+    static void Deallocate(void* ptr, size_t size, size_t alignment) {
+        if (!IsPooled(size, alignment)) {
+            ::operator delete(ptr, std::align_val_t(alignment));
+            return;
+        }
+        size_t index = ClassIndex(size);
+        FreeNode* node = static_cast<FreeNode*>(ptr);
+        if (cache_gone) {
+            frees.fetch_add(1, std::memory_order_relaxed);
+            Central(index).Push(node, node, 1);
+            return;
+        }
+        ThreadCache& cache = Cache();
+        node->next = cache.lists[index];
+        cache.lists[index] = node;
+        ++cache.frees;
+        if (++cache.counts[index] >= 2 * BatchSize(index)) {
+            cache.Flush(index, BatchSize(index));
+        }
+    }
+
+    static PoolStats GetStats() {
+        PoolStats stats;
+        stats.hits = hits.load(std::memory_order_relaxed);
+        stats.misses = misses.load(std::memory_order_relaxed);
+        stats.frees = frees.load(std::memory_order_relaxed);
+        stats.slab_bytes = slab_bytes.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    class CentralList {
+    public:
+        void Push(FreeNode* first, FreeNode* last, size_t count) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            last->next = head_;
+            head_ = first;
+            count_ += count;
+        }
+
+        // Takes up to a batch of blocks, carving a new slab if the list is empty
+        FreeNode* PopBatch(size_t index, size_t* count) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (head_ == nullptr) {
+                Grow(index);
+            }
+            FreeNode* first = head_;
+            FreeNode* last = first;
+            *count = 1;
+            while (*count < BatchSize(index) && last->next != nullptr) {
+                last = last->next;
+                ++*count;
+            }
+            head_ = last->next;
+            last->next = nullptr;
+            count_ -= *count;
+            return first;
+        }
+
+        void* Pop(size_t index) {
+            size_t count = 0;
+            FreeNode* batch = PopBatch(index, &count);
+            if (batch->next != nullptr) {
+                FreeNode* last = batch->next;
+                while (last->next != nullptr) {
+                    last = last->next;
+                }
+                Push(batch->next, last, count - 1);
+            }
+            return batch;
+        }
+
+    private:
+        // Slabs hold at least one batch, linked from the end so the list starts at the
+        // lowest address
+        void Grow(size_t index) {
+            size_t block_size = BlockSize(index);
+            size_t blocks = kSlabSize / block_size > BatchSize(index) ? kSlabSize / block_size
+                                                                      : BatchSize(index);
+            char* slab = static_cast<char*>(
+                ::operator new(blocks * block_size, std::align_val_t(kAlignment)));
+            slab_bytes.fetch_add(blocks * block_size, std::memory_order_relaxed);
+            for (size_t block = blocks; block != 0; --block) {
+                FreeNode* node = reinterpret_cast<FreeNode*>(slab + (block - 1) * block_size);
+                node->next = head_;
+                head_ = node;
+            }
+            count_ += blocks;
+        }
+
+        std::mutex mutex_;
+        FreeNode* head_ = nullptr;
+        size_t count_ = 0;
+    };
+
+    struct ThreadCache {
+        FreeNode* lists[kClassCount] = {};
+        size_t counts[kClassCount] = {};
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t frees = 0;
+
+        ~ThreadCache() {
+            for (size_t index = 0; index < kClassCount; ++index) {
+                if (counts[index] != 0) {
+                    Flush(index, counts[index]);
+                }
+            }
+            Publish();
+            cache_gone = true;
+        }
+
+        void Refill(size_t index) {
+            size_t count = 0;
+            lists[index] = Central(index).PopBatch(index, &count);
+            counts[index] = count;
+            Publish();
+        }
+
+        // Hands the first `count` cached blocks of the class back to the central list
+        void Flush(size_t index, size_t count) {
+            FreeNode* first = lists[index];
+            FreeNode* last = first;
+            for (size_t i = 1; i < count; ++i) {
+                last = last->next;
+            }
+            lists[index] = last->next;
+            counts[index] -= count;
+            Central(index).Push(first, last, count);
+            Publish();
+        }
+
+        void Publish() {
+            SlabPool::hits.fetch_add(hits, std::memory_order_relaxed);
+            SlabPool::misses.fetch_add(misses, std::memory_order_relaxed);
+            SlabPool::frees.fetch_add(frees, std::memory_order_relaxed);
+            hits = misses = frees = 0;
+        }
+    };
+
+    static bool IsPooled(size_t size, size_t alignment) {
+        return size <= kMaxSize && alignment <= kAlignment;
+    }
+    static size_t ClassIndex(size_t size) {
+        return size == 0 ? 0 : (size - 1) / kGranularity;
+    }
+    static constexpr size_t BlockSize(size_t index) {
+        return (index + 1) * kGranularity;
+    }
+
+    static CentralList& Central(size_t index) {
+        static CentralList central[kClassCount];
+        return central[index];
+    }
+    static ThreadCache& Cache() {
+        thread_local ThreadCache cache;
+        return cache;
+    }
+
+    // Set once the calling thread's cache is destroyed, later frees from other thread_local
+    // destructors go straight to the central lists
+    static inline thread_local bool cache_gone = false;
+
+    static inline std::atomic<size_t> hits = 0;
+    static inline std::atomic<size_t> misses = 0;
+    static inline std::atomic<size_t> frees = 0;
+    static inline std::atomic<size_t> slab_bytes = 0;
+};
+
+// Pool of the control blocks: classes of 16 bytes up to 256
+using ControlBlockPool = SlabPool<16, 256>;
+
+// Stateless allocator over `ControlBlockPool`, pass it to `AllocateShared` or
+// `SharedPtr(ptr, deleter, alloc)` to pool their control blocks
+template <typename T>
+struct PoolAllocator {
+public:
+    using value_type = T;
+
+    PoolAllocator() = default;
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>&) {
+    }
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(ControlBlockPool::Allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T* ptr, size_t n) {
+        ControlBlockPool::Deallocate(ptr, n * sizeof(T), alignof(T));
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>&) const {
+        return true;
+    }
+    template <typename U>
+    bool operator!=(const PoolAllocator<U>&) const {
+        return false;
+    }
+};
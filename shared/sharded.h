@@ -0,0 +1,271 @@
+#pragma once
+
+#include "shared.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <thread>
+#include <utility>
+
+// Sharded reference counting for a few long-lived objects that every thread copies, in the
+// manner of the Linux kernel's percpu-ref.
+//
+// A block counts exactly, like `AtomicCounting`, until a `ShardedOwner` takes it over. From
+// then on each thread increments and decrements one of `kShardCount` counters on their own
+// cache lines, so copies made on different cores do not contend. The shards of one block may
+// go below zero and only their sum is meaningful, so in this mode a release cannot tell
+// whether it was the last one. It does not have to: the owner holds a reference until it
+// switches the block back, and a bias of `kBias` in the exact count stands for the
+// references held by the shards. The shards are allocated when the block is sharded first,
+// an exact block is as small as an atomic one.
+//
+// The owner switches back when it is destroyed or releases the object. It closes every
+// shard and moves its value into the exact count; an update that finds its shard closed goes
+// to the exact count instead, so no reference is lost. Then the bias is removed and the
+// owner's reference is dropped like any other, so the last owner destroys the object.
+//
+// `GetStrong`, hence `UseCount` and `WeakPtr::Expired`, stays exact while the block is
+// sharded: it closes the shards the same way, reads the exact count and opens them again.
+// That makes it as expensive as a switch and it serializes with other readers, so it is not
+// meant for hot paths.
+class ShardedCounting {
+    enum Mode : int { kExact, kSwitching, kSharded };
+
+    // Closed shards hold values around `kClosed`, far from any count
+    static constexpr int64_t kClosed = INT64_MIN / 2;
+
+public:
+    static constexpr size_t kShardCount = 32;
+    static constexpr int64_t kBias = int64_t(1) << 60;
+
+    ShardedCounting() = default;
+    ~ShardedCounting() {
+        delete[] shards_;
+    }
+
+    ShardedCounting(const ShardedCounting&) = delete;
+    ShardedCounting& operator=(const ShardedCounting&) = delete;
+
+    void IncStrong() {
+        AddStrong(1);
+    }
+    size_t DecStrong() {
+        return SubStrong(1);
+    }
+    void AddStrong(size_t count) {
+        if (mode_.load(std::memory_order_acquire) == kSharded &&
+            !IsClosed(ThreadShard().fetch_add(static_cast<int64_t>(count),
+                                              std::memory_order_relaxed))) {
+            return;
+        }
+        exact_.fetch_add(static_cast<int64_t>(count), std::memory_order_relaxed);
+    }
+    size_t SubStrong(size_t count) {
+        if (mode_.load(std::memory_order_acquire) == kSharded &&
+            !IsClosed(ThreadShard().fetch_sub(static_cast<int64_t>(count),
+                                              std::memory_order_release))) {
+            // The owner's reference is still there
+            return 1;
+        }
+        int64_t result = exact_.fetch_sub(static_cast<int64_t>(count), std::memory_order_release) -
+                         static_cast<int64_t>(count);
+        if (result == 0) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return static_cast<size_t>(result);
+    }
+    // A sharded block is alive as long as its owner, only exact counts can be zero
+    bool IncStrongIfNonZero() {
+        if (mode_.load(std::memory_order_acquire) == kSharded &&
+            !IsClosed(ThreadShard().fetch_add(1, std::memory_order_relaxed))) {
+            return true;
+        }
+        int64_t current = exact_.load(std::memory_order_relaxed);
+        while (current != 0) {
+            if (exact_.compare_exchange_weak(current, current + 1, std::memory_order_acq_rel,
+                                             std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    // Exact in both modes, see the class comment for the cost while sharded
+    size_t GetStrong() const {
+        if (!CloseShards()) {
+            return static_cast<size_t>(exact_.load(std::memory_order_acquire));
+        }
+        int64_t count = exact_.load(std::memory_order_acquire) - kBias;
+        OpenShards();
+        return static_cast<size_t>(count);
+    }
+    bool IsSharded() const {
+        return mode_.load(std::memory_order_acquire) != kExact;
+    }
+
+    void IncWeak() {
+        weak_.fetch_add(1, std::memory_order_relaxed);
+    }
+    size_t DecWeak() {
+        size_t result = weak_.fetch_sub(1, std::memory_order_release) - 1;
+        if (result == 0) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return result;
+    }
+    size_t GetWeak() const {
+        return weak_.load(std::memory_order_acquire);
+    }
+
+    // Switches an exact block to sharded counting, returns false if it is sharded already.
+    // The caller must hold a reference until it calls `Unshard`.
+    bool Shard() {
+        int mode = kExact;
+        if (!mode_.compare_exchange_strong(mode, kSwitching, std::memory_order_acq_rel)) {
+            return false;
+        }
+        if (!shards_) {
+            try {
+                shards_ = new PaddedCounter[kShardCount];
+            } catch (...) {
+                mode_.store(kExact, std::memory_order_release);
+                throw;
+            }
+        }
+        // Updates go to the exact count until the mode is published
+        exact_.fetch_add(kBias, std::memory_order_relaxed);
+        OpenShards();
+        return true;
+    }
+
+    // Moves the shards into the exact count and removes the bias. Called once per `Shard` by
+    // the one who sharded the block, while it still holds its reference.
+    void Unshard() {
+        CloseShards();
+        exact_.fetch_sub(kBias, std::memory_order_acq_rel);
+        mode_.store(kExact, std::memory_order_release);
+    }
+
+private:
+    struct alignas(64) PaddedCounter {
+        std::atomic<int64_t> value = kClosed;
+    };
+
+    static bool IsClosed(int64_t value) {
+        return value < kClosed / 2;
+    }
+
+    // Threads are spread over the shards in the order they first touch a sharded block. The
+    // shards are never freed before the block, so a thread that saw the block sharded once
+    // may use them after it was switched back.
+    std::atomic<int64_t>& ThreadShard() {
+        static std::atomic<size_t> next_shard = 0;
+        thread_local size_t index = next_shard.fetch_add(1, std::memory_order_relaxed);
+        return shards_[index % kShardCount].value;
+    }
+
+    // Moves the shards into the exact count and leaves the block switching, returns false
+    // for an exact block. Waits while another thread has the shards closed.
+    bool CloseShards() const {
+        int mode = mode_.load(std::memory_order_acquire);
+        while (mode != kExact) {
+            if (mode == kSwitching) {
+                std::this_thread::yield();
+                mode = mode_.load(std::memory_order_acquire);
+            } else if (mode_.compare_exchange_weak(mode, kSwitching, std::memory_order_acq_rel,
+                                                   std::memory_order_acquire)) {
+                int64_t sum = 0;
+                for (size_t shard = 0; shard < kShardCount; ++shard) {
+                    sum += shards_[shard].value.exchange(kClosed, std::memory_order_acq_rel);
+                }
+                exact_.fetch_add(sum, std::memory_order_acq_rel);
+                return true;
+            }
+        }
+        return false;
+    }
+    // Opens the closed shards of a switching block and publishes it as sharded
+    void OpenShards() const {
+        for (size_t shard = 0; shard < kShardCount; ++shard) {
+            shards_[shard].value.store(0, std::memory_order_relaxed);
+        }
+        mode_.store(kSharded, std::memory_order_release);
+    }
+
+    PaddedCounter* shards_ = nullptr;
+    // `GetStrong` switches the block too
+    mutable std::atomic<int64_t> exact_ = 1;
+    mutable std::atomic<int> mode_ = kExact;
+    std::atomic<size_t> weak_ = 1;
+};
+
+// Thrown when a block that already has a `ShardedOwner` is given to another one
+class BadShardedOwner : public std::exception {};
+
+// Owner of an object with `ShardedCounting` that keeps its block sharded, see
+// `ShardedCounting`. Copies are handed out with `Share()`; destroying the owner or taking
+// its reference back with `Release()` switches the block to exact counting, so the object is
+// destroyed by whoever drops the last reference, the owner included.
+template <typename T>
+class ShardedOwner {
+public:
+    ShardedOwner() = default;
+
+    // Takes over `ptr`. A block can have one owner at a time, for a block that has one
+    // already `BadShardedOwner` is thrown.
+    explicit ShardedOwner(SharedPtr<T, ShardedCounting> ptr) : ptr_(std::move(ptr)) {
+        if (ptr_.block_ && !ptr_.block_->GetCounts().Shard()) {
+            throw BadShardedOwner();
+        }
+    }
+
+    ShardedOwner(ShardedOwner&& other) noexcept : ptr_(std::move(other.ptr_)) {
+    }
+    ShardedOwner& operator=(ShardedOwner&& other) noexcept {
+        ShardedOwner(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    ~ShardedOwner() {
+        Release();
+    }
+
+    // Switches the block to exact counting and hands over the owner's reference
+    SharedPtr<T, ShardedCounting> Release() {
+        if (ptr_.block_) {
+            ptr_.block_->GetCounts().Unshard();
+        }
+        return std::move(ptr_);
+    }
+
+    void Swap(ShardedOwner& other) noexcept {
+        ptr_.Swap(other.ptr_);
+    }
+
+    // Observers
+
+    SharedPtr<T, ShardedCounting> Share() const {
+        return ptr_;
+    }
+    T* Get() const {
+        return ptr_.Get();
+    }
+    T& operator*() const {
+        return *ptr_;
+    }
+    T* operator->() const {
+        return ptr_.Get();
+    }
+    explicit operator bool() const {
+        return static_cast<bool>(ptr_);
+    }
+
+private:
+    SharedPtr<T, ShardedCounting> ptr_;
+};
+
+template <typename T, typename... Args>
+ShardedOwner<T> MakeSharded(Args&&... args) {
+    return ShardedOwner<T>(MakeSharedWithPolicy<T, ShardedCounting>(std::forward<Args>(args)...));
+}
@@ -1,17 +1,43 @@
 #pragma once
 
+#include "cycle.h"
 #include "sw_fwd.h"
 
 #include <cstddef>
+#include <functional>
+#include <type_traits>
+#include <utility>
 
-template <typename T>
+template <typename T, typename Policy>
 class SharedPtr {
+    // `T` for objects, the element type for `T[]` and `T[N]`
+    using ElementType = std::remove_extent_t<T>;
+
     template <typename Y>
+    using DefaultDeleter = std::conditional_t<std::is_array_v<T>, Slug<Y[]>, Slug<Y>>;
+
+    template <typename Y, typename P>
     friend class SharedPtr;
 
-    template <typename Y>
+    template <typename Y, typename P>
     friend class WeakPtr;
 
+    template <typename Y, typename P>
+    friend class AtomicSharedPtr;
+
+    template <typename Y, typename P>
+    friend class ThinSharedPtr;
+
+    template <typename Y, typename P>
+    friend class SharedRef;
+
+    friend class SharedPtrBatch<Policy>;
+
+    friend class CycleTracer<Policy>;
+
+    template <typename Y>
+    friend class ShardedOwner;
+
 public:
     // Constructors
 
@@ -19,27 +45,50 @@ public:
     }
     SharedPtr(std::nullptr_t) : block_(nullptr), ptr_(nullptr) {
     }
-    explicit SharedPtr(T* ptr) : block_(new ControlBlockPtr(ptr)), ptr_(ptr) {
-        if constexpr (std::is_convertible_v<T*, ESFTBase*>) {
-            InitWeakThis(ptr_);
-        }
+    // The constructors taking ownership of a `Y*` and the converting ones accept the pointers
+    // `std::shared_ptr` does, see `kOwnableAs` and `kCompatible`
+    template <typename Y, typename = std::enable_if_t<kOwnableAs<Y, T>>>
+    SharedPtr(Y* ptr) : SharedPtr(ptr, DefaultDeleter<Y>(), DefaultBlockAlloc<Y>()) {
     }
-    template <typename Y>
-    SharedPtr(Y* ptr) : block_(new ControlBlockPtr(ptr)), ptr_(static_cast<T*>(ptr)) {
-        if constexpr (std::is_convertible_v<Y*, ESFTBase*>) {
-            InitWeakThis(ptr_);
+
+    // Owns `ptr` through a copy of `deleter`, the control block is allocated with `alloc`.
+    // If the allocation fails, `ptr` is passed to the deleter.
+    template <typename Y, typename Deleter, typename = std::enable_if_t<kOwnableAs<Y, T>>>
+    SharedPtr(Y* ptr, Deleter deleter)
+        : SharedPtr(ptr, std::move(deleter), DefaultBlockAlloc<Y>()) {
+    }
+    template <typename Y, typename Deleter, typename Alloc,
+              typename = std::enable_if_t<kOwnableAs<Y, T>>>
+    SharedPtr(Y* ptr, Deleter deleter, Alloc alloc)
+        : block_(MakePointerBlock(ptr, deleter, alloc)), ptr_(static_cast<ElementType*>(ptr)) {
+        EnableWeakThis(ptr);
+    }
+
+    // Takes over the pointer together with its deleter, `other` is left untouched if the
+    // control block cannot be allocated
+    template <typename Y, typename Deleter, typename = std::enable_if_t<kCompatible<Y, T>>>
+    SharedPtr(UniquePtr<Y, Deleter>&& other) : block_(nullptr), ptr_(other.Get()) {
+        if (ptr_) {
+            using Element = std::remove_extent_t<Y>;
+            using Block = ControlBlockPtr<Element, Policy, Deleter, DefaultBlockAlloc<Element>>;
+            block_ = AllocateControlBlock<Block>(DefaultBlockAlloc<Element>(), other.Get(),
+                                                 std::move(other.GetDeleter()));
+            EnableWeakThis(other.Release());
         }
     }
 
-    template <typename Y>
-    SharedPtr(const SharedPtr<Y>& other) : block_(other.block_), ptr_(static_cast<T*>(other.ptr_)) {
+    template <typename Y, typename = std::enable_if_t<kCompatible<Y, T>>>
+    SharedPtr(const SharedPtr<Y, Policy>& other)
+        : block_(other.block_), ptr_(other.ptr_) {
         if (block_) {
             block_->IncCounter();
         }
     }
 
-    template <typename Y>
-    SharedPtr(SharedPtr<Y>&& other) : block_(other.block_), ptr_(static_cast<T*>(other.ptr_)) {
+    template <typename Y, typename = std::enable_if_t<kCompatible<Y, T>>>
+    SharedPtr(SharedPtr<Y, Policy>&& other) noexcept
+        : block_(other.block_), ptr_(other.ptr_) {
+        other.CheckNotBorrowed();
         other.block_ = nullptr;
         other.ptr_ = nullptr;
     }
@@ -51,7 +100,8 @@ public:
         }
         ptr_ = other.ptr_;
     }
-    SharedPtr(SharedPtr&& other) {
+    SharedPtr(SharedPtr&& other) noexcept {
+        other.CheckNotBorrowed();
         block_ = other.block_;
         other.block_ = nullptr;
 
@@ -62,24 +112,29 @@ public:
     // Aliasing constructor
     // #8 from https://en.cppreference.com/w/cpp/memory/shared_ptr/shared_ptr
     template <typename Y>
-    SharedPtr(const SharedPtr<Y>& other, T* ptr) : block_(other.block_) {  // ?
+    SharedPtr(const SharedPtr<Y, Policy>& other, ElementType* ptr) : block_(other.block_) {  // ?
         if (other.block_) {
             other.block_->IncCounter();
         }
         ptr_ = ptr;
     }
+    // Takes over the reference of `other` instead of adding one, `other` is left empty
+    template <typename Y>
+    SharedPtr(SharedPtr<Y, Policy>&& other, ElementType* ptr) noexcept
+        : block_(other.block_), ptr_(ptr) {
+        other.CheckNotBorrowed();
+        other.block_ = nullptr;
+        other.ptr_ = nullptr;
+    }
 
     // Promote `WeakPtr`
     // #11 from https://en.cppreference.com/w/cpp/memory/shared_ptr/shared_ptr
-    explicit SharedPtr(const WeakPtr<T>& other) {  // to check
-        if (other.Expired()) {
+    explicit SharedPtr(const WeakPtr<T, Policy>& other) {
+        if (!other.block_ || !other.block_->IncCounterIfNonZero()) {
             throw BadWeakPtr();
         }
         block_ = other.block_;
         ptr_ = other.ptr_;
-        if (block_) {
-            block_->IncCounter();
-        }
     }
 
     // `operator=`-s
@@ -88,6 +143,7 @@ public:
         if (this == &other) {
             return *this;
         }
+        CheckNotBorrowed();
         if (block_) {
             block_->DecCounter();
         }
@@ -99,18 +155,8 @@ public:
         ptr_ = other.ptr_;
         return *this;
     }
-    SharedPtr& operator=(SharedPtr&& other) {
-        if (this == &other) {
-            return *this;
-        }
-        if (block_) {
-            block_->DecCounter();
-        }
-        block_ = other.block_;
-        other.block_ = nullptr;
-
-        ptr_ = other.ptr_;
-        other.ptr_ = nullptr;
+    SharedPtr& operator=(SharedPtr&& other) noexcept {
+        SharedPtr(std::move(other)).Swap(*this);
         return *this;
     }
 
@@ -123,52 +169,59 @@ public:
     // Modifiers
 
     void Reset() {
+        CheckNotBorrowed();
         if (block_) {
-            if constexpr (std::is_convertible_v<T*, ESFTBase*>) {
-                if (block_->GetCounter() == 1 && block_->GetWeakCounter() == 1) {
-                    ptr_->weak_this_.Reset();
-                }
-            }
             block_->DecCounter();
         }
         block_ = nullptr;
         ptr_ = nullptr;
     }
-    void Reset(T* ptr) {
-        if (block_) {
-            block_->DecCounter();
-        }
-        block_ = new ControlBlockPtr(ptr);
-        ptr_ = ptr;
-    }
-    template <typename Y>
+    template <typename Y, typename = std::enable_if_t<kOwnableAs<Y, T>>>
     void Reset(Y* ptr) {
-        if (block_) {
-            block_->DecCounter();
-        }
-        block_ = new ControlBlockPtr(ptr);
-        ptr_ = ptr;
+        SharedPtr(ptr).Swap(*this);
+    }
+    template <typename Y, typename Deleter, typename = std::enable_if_t<kOwnableAs<Y, T>>>
+    void Reset(Y* ptr, Deleter deleter) {
+        SharedPtr(ptr, std::move(deleter)).Swap(*this);
+    }
+    template <typename Y, typename Deleter, typename Alloc,
+              typename = std::enable_if_t<kOwnableAs<Y, T>>>
+    void Reset(Y* ptr, Deleter deleter, Alloc alloc) {
+        SharedPtr(ptr, std::move(deleter), std::move(alloc)).Swap(*this);
     }
 
-    void Swap(SharedPtr& other) {
-        ControlBlockBase* tmp = block_;
+    void Swap(SharedPtr& other) noexcept {
+        CheckNotBorrowed();
+        other.CheckNotBorrowed();
+        ControlBlockBase<Policy>* tmp = block_;
         block_ = other.block_;
         other.block_ = tmp;
 
         std::swap(ptr_, other.ptr_);
     }
 
+    // Bulk operations for arrays of pointers that share few objects: reference counts are
+    // adjusted once per control block instead of once per element
+
+    // Assigns `source[i]` to `target[i]` for `i < count`, the ranges must not overlap
+    static void CopyN(const SharedPtr* source, size_t count, SharedPtr* target);
+    // Resets `count` pointers starting at `ptrs`
+    static void DestroyN(SharedPtr* ptrs, size_t count);
+
     // Observers
 
-    T* Get() const {
+    ElementType* Get() const {
         return ptr_;
     }
-    T& operator*() const {
+    std::add_lvalue_reference_t<ElementType> operator*() const {
         return *ptr_;
     }
-    T* operator->() const {
+    ElementType* operator->() const {
         return ptr_;
     }
+    std::add_lvalue_reference_t<ElementType> operator[](std::ptrdiff_t index) const {
+        return ptr_[index];
+    }
     size_t UseCount() const {
         if (block_) {
             return block_->GetCounter();
@@ -176,58 +229,332 @@ public:
         return 0;
     }
     explicit operator bool() const {
-        return UseCount() > 0;
+        return ptr_ != nullptr;
+    }
+
+    // Owner-based ordering and hashing: pointers sharing a control block are equivalent,
+    // whatever they point to and even after the object expired
+    template <typename Y>
+    bool OwnerBefore(const SharedPtr<Y, Policy>& other) const {
+        return std::less<const void*>()(block_, other.block_);
+    }
+    template <typename Y>
+    bool OwnerBefore(const WeakPtr<Y, Policy>& other) const {
+        return std::less<const void*>()(block_, other.block_);
+    }
+    template <typename Y>
+    bool OwnerEquals(const SharedPtr<Y, Policy>& other) const {
+        return block_ == other.block_;
+    }
+    template <typename Y>
+    bool OwnerEquals(const WeakPtr<Y, Policy>& other) const {
+        return block_ == other.block_;
+    }
+    size_t OwnerHash() const {
+        return std::hash<const void*>()(block_);
     }
 
 private:
-    SharedPtr(ControlBlockObject<T>* block) : block_(block), ptr_(block->GetPointer()) {
-        if constexpr (std::is_convertible_v<T*, ESFTBase*>) {
-            InitWeakThis(ptr_);
-        }
+    // Adopts a strong reference already taken on `block`
+    struct AdoptRef {};
+    SharedPtr(AdoptRef, ControlBlockBase<Policy>* block, ElementType* ptr)
+        : block_(block), ptr_(ptr) {
     }
 
-    template <typename Y, typename... Args>
-    friend SharedPtr<Y> MakeShared(Args&&... args);
+    template <typename D, typename Y, typename P>
+    friend D* GetDeleter(const SharedPtr<Y, P>& ptr);
+
+    template <typename Y, typename P, typename Alloc, typename... Args>
+    friend SharedPtr<Y, P> AllocateSharedWithPolicy(const Alloc& alloc, Args&&... args);
+
+    template <typename Y, typename P, typename Alloc, typename Construct>
+    friend SharedPtr<Y, P> AllocateSharedArray(const Alloc& alloc, size_t size,
+                                               Construct construct);
+
+    template <typename Y, typename Deleter, typename Alloc>
+    static ControlBlockBase<Policy>* MakePointerBlock(Y* ptr, Deleter& deleter,
+                                                      const Alloc& alloc) {
+        try {
+            return AllocateControlBlock<ControlBlockPtr<Y, Policy, Deleter, Alloc>>(alloc, ptr,
+                                                                                   deleter);
+        } catch (...) {
+            deleter(ptr);
+            throw;
+        }
+    }
 
     template <typename Y>
-    void InitWeakThis(EnableSharedFromThis<Y>* e) {
+    void EnableWeakThis(Y* ptr) {
+        if constexpr (std::is_convertible_v<Y*, ESFTBase*>) {
+            InitWeakThis(ptr);
+        }
+    }
+    template <typename Y>
+    void InitWeakThis(EnableSharedFromThis<Y, Policy>* e) {
         e->weak_this_ = *this;
     }
 
-    T* ptr_;
-    ControlBlockBase* block_;
+    // Checked builds terminate when a pointer that `SharedRef`-s borrow from changes
+    void CheckNotBorrowed() const {
+        if constexpr (kBorrowChecksEnabled) {
+            BorrowRegistry::CheckNotBorrowed(this);
+        }
+    }
+
+    ControlBlockBase<Policy>* block_;
+    ElementType* ptr_;
+};
+
+// Holds no pointers into itself, so it can be moved with `memcpy`
+template <typename T, typename Policy>
+struct IsTriviallyRelocatable<SharedPtr<T, Policy>> : std::true_type {};
+
+// Collects reference count changes of `SharedPtr`-s with the same policy and applies them
+// as one `AddCounter`/`SubCounter` per control block on `Flush()` or destruction. Up to
+// `kSlots` blocks are tracked at once, a new one beyond that flushes the batch first.
+template <typename Policy>
+class SharedPtrBatch {
+public:
+    static constexpr size_t kSlots = 16;
+
+    SharedPtrBatch() = default;
+    SharedPtrBatch(const SharedPtrBatch&) = delete;
+    SharedPtrBatch& operator=(const SharedPtrBatch&) = delete;
+
+    ~SharedPtrBatch() {
+        Flush();
+    }
+
+    // Copy of `ptr` whose reference is only taken by the next `Flush()`. Until then `ptr`
+    // must stay alive and the copy must not be released.
+    template <typename T>
+    SharedPtr<T, Policy> Copy(const SharedPtr<T, Policy>& ptr) {
+        if (ptr.block_) {
+            Adjust(ptr.block_, 1);
+        }
+        return SharedPtr<T, Policy>(typename SharedPtr<T, Policy>::AdoptRef(), ptr.block_,
+                                    ptr.ptr_);
+    }
+    // Takes the reference of `ptr`, it is dropped by the next `Flush()`
+    template <typename T>
+    void Release(SharedPtr<T, Policy>& ptr) {
+        if (ptr.block_) {
+            Adjust(ptr.block_, -1);
+        }
+        ptr.block_ = nullptr;
+        ptr.ptr_ = nullptr;
+    }
+
+    // Takes all references before dropping any, dropped ones may destroy objects
+    void Flush() {
+        size_t size = size_;
+        size_ = 0;
+        for (size_t i = 0; i < size; ++i) {
+            if (slots_[i].delta > 0) {
+                slots_[i].block->AddCounter(static_cast<size_t>(slots_[i].delta));
+            }
+        }
+        for (size_t i = 0; i < size; ++i) {
+            if (slots_[i].delta < 0) {
+                slots_[i].block->SubCounter(static_cast<size_t>(-slots_[i].delta));
+            }
+        }
+    }
+
+private:
+    struct Slot {
+        ControlBlockBase<Policy>* block;
+        std::ptrdiff_t delta;
+    };
+
+    void Adjust(ControlBlockBase<Policy>* block, std::ptrdiff_t delta) {
+        for (size_t i = 0; i < size_; ++i) {
+            if (slots_[i].block == block) {
+                slots_[i].delta += delta;
+                return;
+            }
+        }
+        if (size_ == kSlots) {
+            Flush();
+        }
+        slots_[size_++] = {block, delta};
+    }
+
+    Slot slots_[kSlots];
+    size_t size_ = 0;
 };
 
-template <typename T, typename U>
-inline bool operator==(const SharedPtr<T>& left, const SharedPtr<U>& right) {
+template <typename T, typename Policy>
+void SharedPtr<T, Policy>::CopyN(const SharedPtr* source, size_t count, SharedPtr* target) {
+    SharedPtrBatch<Policy> batch;
+    for (size_t i = 0; i < count; ++i) {
+        batch.Release(target[i]);
+        target[i] = batch.Copy(source[i]);
+    }
+}
+
+template <typename T, typename Policy>
+void SharedPtr<T, Policy>::DestroyN(SharedPtr* ptrs, size_t count) {
+    SharedPtrBatch<Policy> batch;
+    for (size_t i = 0; i < count; ++i) {
+        batch.Release(ptrs[i]);
+    }
+}
+
+template <typename T, typename U, typename Policy>
+inline bool operator==(const SharedPtr<T, Policy>& left, const SharedPtr<U, Policy>& right) {
     return left.Get() == right.Get();
 }
 
+// Deleter of the control block if it is a `D`, null otherwise
+template <typename D, typename T, typename Policy>
+D* GetDeleter(const SharedPtr<T, Policy>& ptr) {
+    if (!ptr.block_) {
+        return nullptr;
+    }
+    return static_cast<D*>(ptr.block_->GetDeleter(&TypeTag<D>::kId));
+}
+
+// Casts share the object through the aliasing constructors. The overloads for rvalues move
+// the reference instead of taking a new one, a failed `DynamicPointerCast` leaves its
+// argument untouched.
+
+template <typename T, typename U, typename Policy>
+SharedPtr<T, Policy> StaticPointerCast(const SharedPtr<U, Policy>& ptr) {
+    return SharedPtr<T, Policy>(ptr, static_cast<std::remove_extent_t<T>*>(ptr.Get()));
+}
+template <typename T, typename U, typename Policy>
+SharedPtr<T, Policy> StaticPointerCast(SharedPtr<U, Policy>&& ptr) {
+    auto* result = static_cast<std::remove_extent_t<T>*>(ptr.Get());
+    return SharedPtr<T, Policy>(std::move(ptr), result);
+}
+
+template <typename T, typename U, typename Policy>
+SharedPtr<T, Policy> ConstPointerCast(const SharedPtr<U, Policy>& ptr) {
+    return SharedPtr<T, Policy>(ptr, const_cast<std::remove_extent_t<T>*>(ptr.Get()));
+}
+template <typename T, typename U, typename Policy>
+SharedPtr<T, Policy> ConstPointerCast(SharedPtr<U, Policy>&& ptr) {
+    auto* result = const_cast<std::remove_extent_t<T>*>(ptr.Get());
+    return SharedPtr<T, Policy>(std::move(ptr), result);
+}
+
+template <typename T, typename U, typename Policy>
+SharedPtr<T, Policy> DynamicPointerCast(const SharedPtr<U, Policy>& ptr) {
+    if (auto* result = dynamic_cast<std::remove_extent_t<T>*>(ptr.Get())) {
+        return SharedPtr<T, Policy>(ptr, result);
+    }
+    return SharedPtr<T, Policy>();
+}
+template <typename T, typename U, typename Policy>
+SharedPtr<T, Policy> DynamicPointerCast(SharedPtr<U, Policy>&& ptr) {
+    if (auto* result = dynamic_cast<std::remove_extent_t<T>*>(ptr.Get())) {
+        return SharedPtr<T, Policy>(std::move(ptr), result);
+    }
+    return SharedPtr<T, Policy>();
+}
+
+// Single allocation for the control block and `size` elements built by `construct`
+template <typename T, typename Policy, typename Alloc, typename Construct>
+SharedPtr<T, Policy> AllocateSharedArray(const Alloc& alloc, size_t size, Construct construct) {
+    using Block = ControlBlockArray<std::remove_extent_t<T>, Policy, Alloc>;
+    Block* block = Block::Create(alloc, size, construct);
+    return SharedPtr<T, Policy>(typename SharedPtr<T, Policy>::AdoptRef(), block,
+                                block->GetPointer());
+}
+
+template <typename T, typename Policy, typename Alloc>
+SharedPtr<T, Policy> AllocateSharedArrayOf(const Alloc& alloc, size_t size) {
+    using Element = std::remove_extent_t<T>;
+    return AllocateSharedArray<T, Policy>(alloc, size,
+                                          [](Element* element) { new (element) Element(); });
+}
+template <typename T, typename Policy, typename Alloc>
+SharedPtr<T, Policy> AllocateSharedArrayOf(const Alloc& alloc, size_t size,
+                                           const std::remove_extent_t<T>& value) {
+    using Element = std::remove_extent_t<T>;
+    return AllocateSharedArray<T, Policy>(
+        alloc, size, [&value](Element* element) { new (element) Element(value); });
+}
+template <typename T, typename Policy, typename Alloc>
+SharedPtr<T, Policy> AllocateSharedArrayOf(const Alloc& alloc, size_t size, ForOverwriteTag) {
+    using Element = std::remove_extent_t<T>;
+    return AllocateSharedArray<T, Policy>(alloc, size,
+                                          [](Element* element) { new (element) Element; });
+}
+
+// Allocates the control block together with the object through `alloc`
+template <typename T, typename Policy, typename Alloc, typename... Args>
+SharedPtr<T, Policy> AllocateSharedWithPolicy(const Alloc& alloc, Args&&... args) {
+    if constexpr (std::is_array_v<T> && std::extent_v<T> == 0) {
+        // `MakeShared<T[]>(size)` or `MakeShared<T[]>(size, value)`
+        return AllocateSharedArrayOf<T, Policy>(alloc, std::forward<Args>(args)...);
+    } else if constexpr (std::is_array_v<T>) {
+        // `MakeShared<T[N]>()` or `MakeShared<T[N]>(value)`
+        return AllocateSharedArrayOf<T, Policy>(alloc, std::extent_v<T>,
+                                                std::forward<Args>(args)...);
+    } else {
+        using Block = ControlBlockObject<T, Policy, Alloc>;
+        Block* block = AllocateControlBlock<Block>(alloc, std::forward<Args>(args)...);
+        SharedPtr<T, Policy> result(typename SharedPtr<T, Policy>::AdoptRef(), block,
+                                    block->GetPointer());
+        result.EnableWeakThis(result.ptr_);
+        return result;
+    }
+}
+
+template <typename T, typename Alloc, typename... Args>
+SharedPtr<T> AllocateShared(const Alloc& alloc, Args&&... args) {
+    return AllocateSharedWithPolicy<T, DefaultCounting>(alloc, std::forward<Args>(args)...);
+}
+
+template <typename T, typename Policy, typename... Args>
+SharedPtr<T, Policy> MakeSharedWithPolicy(Args&&... args) {
+    return AllocateSharedWithPolicy<T, Policy>(DefaultBlockAlloc<std::remove_extent_t<T>>(),
+                                               std::forward<Args>(args)...);
+}
+
 template <typename T, typename... Args>
 SharedPtr<T> MakeShared(Args&&... args) {
-    return SharedPtr<T>(new ControlBlockObject<T>(std::forward<Args>(args)...));
+    return MakeSharedWithPolicy<T, DefaultCounting>(std::forward<Args>(args)...);
+}
+
+// `MakeSharedForOverwrite<T>()`, `<T[]>(size)` and `<T[N]>()` default-initialize the object
+// or the elements instead of value-initializing them, so trivial types are not zeroed
+template <typename T, typename Policy, typename... Size>
+SharedPtr<T, Policy> MakeSharedForOverwriteWithPolicy(Size... size) {
+    static_assert(sizeof...(Size) == (std::is_array_v<T> && std::extent_v<T> == 0 ? 1 : 0),
+                  "only arrays of unknown bound take a size");
+    return AllocateSharedWithPolicy<T, Policy>(DefaultBlockAlloc<std::remove_extent_t<T>>(),
+                                               static_cast<size_t>(size)..., ForOverwriteTag());
+}
+
+template <typename T, typename... Size>
+SharedPtr<T> MakeSharedForOverwrite(Size... size) {
+    return MakeSharedForOverwriteWithPolicy<T, DefaultCounting>(size...);
 }
 
-template <typename T>
+template <typename T, typename Policy>
 class EnableSharedFromThis : public ESFTBase {
-    template <typename Y>
+    template <typename Y, typename P>
     friend class SharedPtr;
 
 public:
-    SharedPtr<T> SharedFromThis() {
-        return SharedPtr<T>(this->weak_this_);
+    // Empty if the object is not owned by any `SharedPtr`
+    SharedPtr<T, Policy> SharedFromThis() {
+        return this->weak_this_.Lock();
     }
-    SharedPtr<const T> SharedFromThis() const {
-        return SharedPtr<const T>(this->weak_this_);
+    SharedPtr<const T, Policy> SharedFromThis() const {
+        return this->weak_this_.Lock();
     }
 
-    WeakPtr<T> WeakFromThis() noexcept {
-        return WeakPtr<T>(this->weak_this_);
+    WeakPtr<T, Policy> WeakFromThis() noexcept {
+        return WeakPtr<T, Policy>(this->weak_this_);
     }
-    WeakPtr<const T> WeakFromThis() const noexcept {
-        return WeakPtr<const T>(this->weak_this_);
+    WeakPtr<const T, Policy> WeakFromThis() const noexcept {
+        return WeakPtr<const T, Policy>(this->weak_this_);
     }
 
 private:
-    WeakPtr<T> weak_this_;
+    WeakPtr<T, Policy> weak_this_;
 };
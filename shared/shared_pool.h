@@ -0,0 +1,79 @@
+#pragma once
+
+#include "pool.h"
+#include "shared.h"
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+// Slot size and alignment of a `SlotPool`, large enough for the pool's free list link
+constexpr size_t SlotAlignment(size_t alignment) {
+    return alignment > alignof(void*) ? alignment : alignof(void*);
+}
+constexpr size_t SlotSize(size_t size, size_t alignment) {
+    size_t slot = size > sizeof(void*) ? size : sizeof(void*);
+    return (slot + SlotAlignment(alignment) - 1) / SlotAlignment(alignment) *
+           SlotAlignment(alignment);
+}
+
+// `SlabPool` with a single size class, for slots of `kSize` bytes aligned to `kAlignment`.
+// Blocks of the same slot size and alignment share one pool.
+template <size_t kSize, size_t kAlignment>
+using SlotPool = SlabPool<SlotSize(kSize, kAlignment), SlotSize(kSize, kAlignment),
+                          SlotAlignment(kAlignment)>;
+
+// Stateless allocator that serves single objects from the `SlotPool` of their size
+template <typename T>
+struct SlotAllocator {
+public:
+    using value_type = T;
+
+    SlotAllocator() = default;
+
+    template <typename U>
+    SlotAllocator(const SlotAllocator<U>&) {
+    }
+
+    // Anything but single objects is larger than the slots and bypasses the pool
+    T* allocate(size_t n) {
+        return static_cast<T*>(
+            SlotPool<sizeof(T), alignof(T)>::Allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T* ptr, size_t n) {
+        SlotPool<sizeof(T), alignof(T)>::Deallocate(ptr, n * sizeof(T), alignof(T));
+    }
+
+    template <typename U>
+    bool operator==(const SlotAllocator<U>&) const {
+        return true;
+    }
+    template <typename U>
+    bool operator!=(const SlotAllocator<U>&) const {
+        return false;
+    }
+};
+
+// `MakeShared` for high-rate short-lived objects. Every object lives with its control block
+// in one slot of a `SlotPool`; when the last strong and weak references are gone the block
+// hands the slot back to the pool of the releasing thread instead of freeing it, and `Make`
+// reuses it without a call to `malloc`.
+template <typename T, typename Policy = DefaultCounting>
+class SharedPool {
+    static_assert(!std::is_array_v<T>, "arrays do not fit in fixed-size slots");
+
+public:
+    using Block = ControlBlockObject<T, Policy, SlotAllocator<T>>;
+    using Pool = SlotPool<sizeof(Block), alignof(Block)>;
+
+    template <typename... Args>
+    static SharedPtr<T, Policy> Make(Args&&... args) {
+        return AllocateSharedWithPolicy<T, Policy>(SlotAllocator<T>(),
+                                                   std::forward<Args>(args)...);
+    }
+
+    // Counters of the slot pool, shared with other blocks of the same size and alignment
+    static PoolStats GetStats() {
+        return Pool::GetStats();
+    }
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "../unique/relocate.h"
+#include "shared.h"
+
+#include <cstddef>
+#include <exception>
+#include <type_traits>
+#include <utility>
+
+// Control block of a borrowed object, a plain pointer unless borrows are checked
+template <typename Policy, bool kChecked = kBorrowChecksEnabled>
+class BorrowedBlock {
+public:
+    BorrowedBlock(ControlBlockBase<Policy>* block, const void*) : block_(block) {
+    }
+
+    ControlBlockBase<Policy>* Get() const {
+        return block_;
+    }
+
+private:
+    ControlBlockBase<Policy>* block_;
+};
+
+// Registers the handle with its source, see `BorrowRegistry`. The weak reference keeps the
+// block readable for the paths that leave a source without resetting it, e.g. `DestroyN`, so
+// a handle used or destroyed after its object terminates the program too instead of reading
+// freed memory.
+template <typename Policy>
+class BorrowedBlock<Policy, true> {
+public:
+    BorrowedBlock(ControlBlockBase<Policy>* block, const void* source)
+        : block_(block), source_(block ? source : nullptr) {
+        if (block_) {
+            block_->IncWeakCounter();
+            BorrowRegistry::Borrow(source_);
+        }
+    }
+
+    BorrowedBlock(const BorrowedBlock& other) : BorrowedBlock(other.Get(), other.source_) {
+    }
+    BorrowedBlock& operator=(const BorrowedBlock& other) {
+        BorrowedBlock copy(other);
+        std::swap(block_, copy.block_);
+        std::swap(source_, copy.source_);
+        return *this;
+    }
+
+    ~BorrowedBlock() {
+        if (block_) {
+            Check();
+            BorrowRegistry::Return(source_);
+            block_->DecWeakCounter();
+        }
+    }
+
+    ControlBlockBase<Policy>* Get() const {
+        if (block_) {
+            Check();
+        }
+        return block_;
+    }
+
+private:
+    void Check() const {
+        if (block_->GetCounter() == 0) {
+            std::terminate();
+        }
+    }
+
+    ControlBlockBase<Policy>* block_;
+    const void* source_;
+};
+
+// Non-owning handle to an object owned by `SharedPtr`-s, for passing it down call chains
+// without touching the reference count: making, copying and dropping a handle are plain
+// pointer copies. The `SharedPtr` it is made from must outlive it, so handles cannot be made
+// from temporaries. `Share()` takes a reference when a callee has to keep the object.
+template <typename T, typename Policy>
+class SharedRef {
+    using ElementType = std::remove_extent_t<T>;
+
+    template <typename Y, typename P>
+    friend class SharedRef;
+
+public:
+    // Constructors
+
+    SharedRef() : block_(nullptr, nullptr), ptr_(nullptr) {
+    }
+    SharedRef(std::nullptr_t) : block_(nullptr, nullptr), ptr_(nullptr) {
+    }
+    SharedRef(const SharedPtr<T, Policy>& ptr) : block_(ptr.block_, &ptr), ptr_(ptr.ptr_) {
+    }
+    template <typename Y, typename = std::enable_if_t<kCompatible<Y, T>>>
+    SharedRef(const SharedPtr<Y, Policy>& ptr)
+        : block_(ptr.block_, &ptr), ptr_(ptr.ptr_) {
+    }
+    SharedRef(SharedPtr<T, Policy>&&) = delete;
+    template <typename Y>
+    SharedRef(SharedPtr<Y, Policy>&&) = delete;
+
+    template <typename Y, typename = std::enable_if_t<kCompatible<Y, T>>>
+    SharedRef(const SharedRef<Y, Policy>& other)
+        : block_(other.block_), ptr_(other.ptr_) {
+    }
+
+    // Owning pointer to the borrowed object
+    SharedPtr<T, Policy> Share() const {
+        ControlBlockBase<Policy>* block = block_.Get();
+        if (!block) {
+            return SharedPtr<T, Policy>();
+        }
+        block->IncCounter();
+        return SharedPtr<T, Policy>(typename SharedPtr<T, Policy>::AdoptRef(), block, ptr_);
+    }
+
+    // Observers
+
+    ElementType* Get() const {
+        block_.Get();
+        return ptr_;
+    }
+    std::add_lvalue_reference_t<ElementType> operator*() const {
+        return *Get();
+    }
+    ElementType* operator->() const {
+        return Get();
+    }
+    std::add_lvalue_reference_t<ElementType> operator[](std::ptrdiff_t index) const {
+        return Get()[index];
+    }
+    size_t UseCount() const {
+        ControlBlockBase<Policy>* block = block_.Get();
+        return block ? block->GetCounter() : 0;
+    }
+    explicit operator bool() const {
+        return Get() != nullptr;
+    }
+
+private:
+    BorrowedBlock<Policy> block_;
+    ElementType* ptr_;
+};
+
+template <typename T, typename Policy>
+struct IsTriviallyRelocatable<SharedRef<T, Policy>> : std::true_type {};
+
+static_assert(kBorrowChecksEnabled || std::is_trivially_copyable_v<SharedRef<int>>);
+static_assert(kBorrowChecksEnabled || sizeof(SharedRef<int>) == sizeof(SharedPtr<int>));
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+// Define SMART_POINTERS_STATS to count, for every type managed by `SharedPtr`, the control
+// blocks and reference count operations of that type. Without it the control blocks carry
+// no statistics and `GetTypeStats()` returns nothing.
+#ifdef SMART_POINTERS_STATS
+inline constexpr bool kStatsEnabled = true;
+#else
+inline constexpr bool kStatsEnabled = false;
+#endif
+
+struct TypeStatsSnapshot {
+    std::string_view type;
+    // Objects not destroyed yet
+    size_t live_objects = 0;
+    size_t peak_objects = 0;
+    // Blocks of destroyed objects kept allocated by weak references, and their memory: for
+    // `MakeShared` blocks including the destroyed object, for arrays without the elements
+    size_t weak_pinned_blocks = 0;
+    size_t peak_weak_pinned_blocks = 0;
+    size_t weak_pinned_bytes = 0;
+    size_t peak_weak_pinned_bytes = 0;
+    // Control blocks created and freed
+    size_t allocations = 0;
+    size_t frees = 0;
+    // Reference count operations, batched ones count every reference
+    size_t strong_incs = 0;
+    size_t strong_decs = 0;
+    size_t weak_incs = 0;
+    size_t weak_decs = 0;
+};
+
+// Counters of one managed type, registered on the first block of that type
+class TypeStats {
+public:
+    constexpr explicit TypeStats(std::string_view type) : type_(type) {
+    }
+
+    TypeStats(const TypeStats&) = delete;
+    TypeStats& operator=(const TypeStats&) = delete;
+
+    void Created() {
+        if (!registered_.load(std::memory_order_relaxed) &&
+            !registered_.exchange(true, std::memory_order_relaxed)) {
+            next_ = head.load(std::memory_order_relaxed);
+            while (!head.compare_exchange_weak(next_, this, std::memory_order_release,
+                                               std::memory_order_relaxed)) {
+            }
+        }
+        allocations_.fetch_add(1, std::memory_order_relaxed);
+        Raise(peak_objects_, live_objects_.fetch_add(1, std::memory_order_relaxed) + 1);
+    }
+    // `pinned` if weak references keep the `bytes` of the block allocated
+    void ObjectDestroyed(bool pinned, size_t bytes) {
+        live_objects_.fetch_sub(1, std::memory_order_relaxed);
+        if (pinned) {
+            Raise(peak_pinned_blocks_,
+                  pinned_blocks_.fetch_add(1, std::memory_order_relaxed) + 1);
+            Raise(peak_pinned_bytes_,
+                  pinned_bytes_.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+        }
+    }
+    void Freed(bool pinned, size_t bytes) {
+        frees_.fetch_add(1, std::memory_order_relaxed);
+        if (pinned) {
+            pinned_blocks_.fetch_sub(1, std::memory_order_relaxed);
+            pinned_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+        }
+    }
+
+    void StrongIncs(size_t count) {
+        strong_incs_.fetch_add(count, std::memory_order_relaxed);
+    }
+    void StrongDecs(size_t count) {
+        strong_decs_.fetch_add(count, std::memory_order_relaxed);
+    }
+    void WeakInc() {
+        weak_incs_.fetch_add(1, std::memory_order_relaxed);
+    }
+    void WeakDec() {
+        weak_decs_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Counters are read one by one, a snapshot taken while other threads work may mix
+    // slightly different moments
+    TypeStatsSnapshot Snapshot() const {
+        TypeStatsSnapshot snapshot;
+        snapshot.type = type_;
+        snapshot.live_objects = live_objects_.load(std::memory_order_relaxed);
+        snapshot.peak_objects = peak_objects_.load(std::memory_order_relaxed);
+        snapshot.weak_pinned_blocks = pinned_blocks_.load(std::memory_order_relaxed);
+        snapshot.peak_weak_pinned_blocks = peak_pinned_blocks_.load(std::memory_order_relaxed);
+        snapshot.weak_pinned_bytes = pinned_bytes_.load(std::memory_order_relaxed);
+        snapshot.peak_weak_pinned_bytes = peak_pinned_bytes_.load(std::memory_order_relaxed);
+        snapshot.allocations = allocations_.load(std::memory_order_relaxed);
+        snapshot.frees = frees_.load(std::memory_order_relaxed);
+        snapshot.strong_incs = strong_incs_.load(std::memory_order_relaxed);
+        snapshot.strong_decs = strong_decs_.load(std::memory_order_relaxed);
+        snapshot.weak_incs = weak_incs_.load(std::memory_order_relaxed);
+        snapshot.weak_decs = weak_decs_.load(std::memory_order_relaxed);
+        return snapshot;
+    }
+
+    static std::vector<TypeStatsSnapshot> SnapshotAll() {
+        std::vector<TypeStatsSnapshot> result;
+        for (TypeStats* stats = head.load(std::memory_order_acquire); stats != nullptr;
+             stats = stats->next_) {
+            result.push_back(stats->Snapshot());
+        }
+        return result;
+    }
+
+private:
+    static void Raise(std::atomic<size_t>& peak, size_t value) {
+        size_t current = peak.load(std::memory_order_relaxed);
+        while (value > current &&
+               !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    static inline std::atomic<TypeStats*> head = nullptr;
+
+    std::string_view type_;
+    std::atomic<bool> registered_ = false;
+    TypeStats* next_ = nullptr;
+
+    std::atomic<size_t> live_objects_ = 0;
+    std::atomic<size_t> peak_objects_ = 0;
+    std::atomic<size_t> pinned_blocks_ = 0;
+    std::atomic<size_t> peak_pinned_blocks_ = 0;
+    std::atomic<size_t> pinned_bytes_ = 0;
+    std::atomic<size_t> peak_pinned_bytes_ = 0;
+    std::atomic<size_t> allocations_ = 0;
+    std::atomic<size_t> frees_ = 0;
+    std::atomic<size_t> strong_incs_ = 0;
+    std::atomic<size_t> strong_decs_ = 0;
+    std::atomic<size_t> weak_incs_ = 0;
+    std::atomic<size_t> weak_decs_ = 0;
+};
+
+// Readable name of `T` without RTTI, taken from the compiler's function signature
+template <typename T>
+constexpr std::string_view TypeName() {
+#if defined(__GNUC__) || defined(__clang__)
+    std::string_view signature = __PRETTY_FUNCTION__;
+    size_t start = signature.find("T = ");
+    if (start == std::string_view::npos) {
+        return signature;
+    }
+    start += 4;
+    size_t end = signature.find_first_of(";]", start);
+    return signature.substr(start, end - start);
+#else
+    return "unknown";
+#endif
+}
+
+template <typename T>
+struct TypeStatsOf {
+    static inline TypeStats stats{TypeName<T>()};
+};
+
+// Statistics of every type that had a control block so far, in no particular order
+inline std::vector<TypeStatsSnapshot> GetTypeStats() {
+    return TypeStats::SnapshotAll();
+}
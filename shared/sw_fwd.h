@@ -1,107 +1,816 @@
 #pragma once
 
+#include "../unique/unique.h"
+#include "borrows.h"
+#include "deferred.h"
+#include "stats.h"
+
+#ifdef SMART_POINTERS_POOLED_BLOCKS
+#include "pool.h"
+#endif
+
 #include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <exception>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Counting policies
+//
+// Both counts start at one: the strong one for the `SharedPtr` that creates the block and
+// the weak one shared by all strong owners together, so the block is freed by whoever drops
+// the last weak reference. Decrements return the new value, that is the only value a caller
+// may base the destruction decision on.
+
+// Plain counters for blocks that never leave one thread.
+class LocalCounting {
+public:
+    void IncStrong() {
+        ++strong_;
+    }
+    size_t DecStrong() {
+        return --strong_;
+    }
+    void AddStrong(size_t count) {
+        strong_ += count;
+    }
+    size_t SubStrong(size_t count) {
+        return strong_ -= count;
+    }
+    bool IncStrongIfNonZero() {
+        if (strong_ == 0) {
+            return false;
+        }
+        ++strong_;
+        return true;
+    }
+    size_t GetStrong() const {
+        return strong_;
+    }
+
+    void IncWeak() {
+        ++weak_;
+    }
+    size_t DecWeak() {
+        return --weak_;
+    }
+    size_t GetWeak() const {
+        return weak_;
+    }
+
+private:
+    size_t strong_ = 1;
+    size_t weak_ = 1;
+};
+
+// Increments are relaxed, since a new reference is always made from an existing one.
+// Decrements release the owner's writes and the one reaching zero acquires all of them
+// before anything is destroyed.
+class AtomicCounting {
+public:
+    void IncStrong() {
+        strong_.fetch_add(1, std::memory_order_relaxed);
+    }
+    size_t DecStrong() {
+        size_t result = strong_.fetch_sub(1, std::memory_order_release) - 1;
+        if (result == 0) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return result;
+    }
+    void AddStrong(size_t count) {
+        strong_.fetch_add(count, std::memory_order_relaxed);
+    }
+    size_t SubStrong(size_t count) {
+        size_t result = strong_.fetch_sub(count, std::memory_order_release) - count;
+        if (result == 0) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return result;
+    }
+    // Promotion of a weak reference: a single CAS that never resurrects a dead object.
+    bool IncStrongIfNonZero() {
+        size_t current = strong_.load(std::memory_order_relaxed);
+        while (current != 0) {
+            if (strong_.compare_exchange_weak(current, current + 1, std::memory_order_acq_rel,
+                                              std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    size_t GetStrong() const {
+        return strong_.load(std::memory_order_acquire);
+    }
+
+    void IncWeak() {
+        weak_.fetch_add(1, std::memory_order_relaxed);
+    }
+    size_t DecWeak() {
+        size_t result = weak_.fetch_sub(1, std::memory_order_release) - 1;
+        if (result == 0) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return result;
+    }
+    size_t GetWeak() const {
+        return weak_.load(std::memory_order_acquire);
+    }
+
+private:
+    std::atomic<size_t> strong_ = 1;
+    std::atomic<size_t> weak_ = 1;
+};
+
+// Thread-safe counts packed into one 8-byte word, 32 bits each, for programs that hold
+// very many small shared objects. Either count reaching `kLimit` is treated like running
+// out of memory: there is no way to continue correctly, so the program is terminated
+// before the strong count could carry into the weak one.
+class CompactCounting {
+    static constexpr uint64_t kStrongOne = 1;
+    static constexpr uint64_t kWeakOne = uint64_t(1) << 32;
+    static constexpr uint64_t kStrongMask = kWeakOne - 1;
+
+public:
+    static constexpr uint64_t kLimit = uint64_t(1) << 31;
+
+    void IncStrong() {
+        Check(Strong(counts_.fetch_add(kStrongOne, std::memory_order_relaxed)), 1);
+    }
+    size_t DecStrong() {
+        size_t result = Strong(counts_.fetch_sub(kStrongOne, std::memory_order_release)) - 1;
+        if (result == 0) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return result;
+    }
+    void AddStrong(size_t count) {
+        Check(Strong(counts_.fetch_add(count * kStrongOne, std::memory_order_relaxed)), count);
+    }
+    size_t SubStrong(size_t count) {
+        size_t result =
+            Strong(counts_.fetch_sub(count * kStrongOne, std::memory_order_release)) - count;
+        if (result == 0) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return result;
+    }
+    bool IncStrongIfNonZero() {
+        uint64_t current = counts_.load(std::memory_order_relaxed);
+        while (Strong(current) != 0) {
+            Check(Strong(current), 1);
+            if (counts_.compare_exchange_weak(current, current + kStrongOne,
+                                              std::memory_order_acq_rel,
+                                              std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    size_t GetStrong() const {
+        return Strong(counts_.load(std::memory_order_acquire));
+    }
+
+    void IncWeak() {
+        Check(Weak(counts_.fetch_add(kWeakOne, std::memory_order_relaxed)), 1);
+    }
+    size_t DecWeak() {
+        size_t result = Weak(counts_.fetch_sub(kWeakOne, std::memory_order_release)) - 1;
+        if (result == 0) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return result;
+    }
+    size_t GetWeak() const {
+        return Weak(counts_.load(std::memory_order_acquire));
+    }
+
+private:
+    static size_t Strong(uint64_t counts) {
+        return counts & kStrongMask;
+    }
+    static size_t Weak(uint64_t counts) {
+        return counts >> 32;
+    }
+    // `old` is the count before `added` was added to it
+    static void Check(uint64_t old, uint64_t added) {
+        if (old + added >= kLimit) {
+            std::terminate();
+        }
+    }
+
+    std::atomic<uint64_t> counts_ = kStrongOne + kWeakOne;
+};
+
+// Define SMART_POINTERS_SINGLE_THREADED to make plain counters the default everywhere.
+#ifdef SMART_POINTERS_SINGLE_THREADED
+using DefaultCounting = LocalCounting;
+#else
+using DefaultCounting = AtomicCounting;
+#endif
+
+// Define SMART_POINTERS_POOLED_BLOCKS to allocate the control blocks of `MakeShared` and
+// `SharedPtr(T*)` from the thread-caching `ControlBlockPool`.
+#ifdef SMART_POINTERS_POOLED_BLOCKS
+template <typename T>
+using DefaultBlockAlloc = PoolAllocator<T>;
+#else
+template <typename T>
+using DefaultBlockAlloc = std::allocator<T>;
+#endif
+
+// Define SMART_POINTERS_CYCLE_COLLECTOR to record blocks of types that can form `SharedPtr`
+// cycles as candidates for `CollectCycles()`, see `shared/cycle.h`.
+#ifdef SMART_POINTERS_CYCLE_COLLECTOR
+inline constexpr bool kCycleCollectorEnabled = true;
+#else
+inline constexpr bool kCycleCollectorEnabled = false;
+#endif
+
+template <typename Policy = DefaultCounting>
+class CycleTracer;
+
+template <typename Policy>
+class CycleCollector;
+
+// Types opt in to cycle collection with a member that passes every `SharedPtr` member that
+// may be part of a cycle to the tracer, the same ones on every call:
+//
+//     void TraceRefs(CycleTracer<>& tracer) {
+//         tracer(next_);
+//     }
+template <typename T, typename Policy, typename = void>
+inline constexpr bool kTraceable = false;
+template <typename T, typename Policy>
+inline constexpr bool kTraceable<
+    T, Policy,
+    std::void_t<decltype(std::declval<T&>().TraceRefs(std::declval<CycleTracer<Policy>&>()))>> =
+    true;
+
+// Unique address per type, identifies stored deleters without RTTI
+template <typename T>
+struct TypeTag {
+    static inline const char kId = 0;
+};
+
+// Control blocks
 
-struct ControlBlockBase {
+template <typename Policy>
+struct ControlBlockBase;
+
+// Hooks of one block kind. Blocks point to a shared constant table instead of carrying a
+// vtable, and hooks that have nothing to do are null so the release path can skip the call.
+template <typename Policy>
+struct ControlBlockOps {
+    // Ends the lifetime of the managed object
+    void (*destroy_object)(ControlBlockBase<Policy>*);
+    // Destroys the block and frees its memory through the block's allocator
+    void (*deallocate)(ControlBlockBase<Policy>*);
+    // Address of the stored deleter if its `TypeTag` is `type`
+    void* (*get_deleter)(ControlBlockBase<Policy>*, const void* type);
+#ifdef SMART_POINTERS_CYCLE_COLLECTOR
+    // Passes the `SharedPtr`-s held by the managed object to the tracer
+    void (*trace)(ControlBlockBase<Policy>*, CycleTracer<Policy>&);
+#endif
+#ifdef SMART_POINTERS_STATS
+    // Statistics of the managed type, and the memory weak references keep after the object
+    // is destroyed
+    TypeStats* stats;
+    size_t block_size;
+#endif
+};
+
+// Hook table of a block of `block_size` bytes managing a `T`
+template <typename T, typename Policy>
+constexpr ControlBlockOps<Policy> MakeBlockOps(void (*destroy_object)(ControlBlockBase<Policy>*),
+                                               void (*deallocate)(ControlBlockBase<Policy>*),
+                                               void* (*get_deleter)(ControlBlockBase<Policy>*,
+                                                                    const void*),
+                                               [[maybe_unused]] void (*trace)(
+                                                   ControlBlockBase<Policy>*, CycleTracer<Policy>&),
+                                               [[maybe_unused]] size_t block_size) {
+    ControlBlockOps<Policy> ops{};
+    ops.destroy_object = destroy_object;
+    ops.deallocate = deallocate;
+    ops.get_deleter = get_deleter;
+#ifdef SMART_POINTERS_CYCLE_COLLECTOR
+    ops.trace = trace;
+#endif
+#ifdef SMART_POINTERS_STATS
+    ops.stats = &TypeStatsOf<T>::stats;
+    ops.block_size = block_size;
+#endif
+    return ops;
+}
+
+// Policies that have to reach their block later, e.g. to drop a reference handed to another
+// thread, declare `void Bind(ControlBlockBase<Policy>*)`
+template <typename Policy, typename = void>
+inline constexpr bool kBindsBlock = false;
+template <typename Policy>
+inline constexpr bool kBindsBlock<Policy, std::void_t<decltype(&Policy::Bind)>> = true;
+
+// Releases are deferred only in builds that enable it, and only for policies whose counts may
+// be finished on the reclaiming thread
+template <typename Policy>
+inline constexpr bool kDefersRelease =
+    kDeferredReleaseEnabled && !std::is_same_v<Policy, LocalCounting>;
+
+// Blocks carry the link of the deferred release queue only if their releases can be deferred
+struct NoDeferredNode {};
+template <typename Policy>
+using DeferredLink = std::conditional_t<kDefersRelease<Policy>, DeferredNode, NoDeferredNode>;
+
+template <typename Policy>
+struct ControlBlockBase : private DeferredLink<Policy> {
 public:
-    virtual ~ControlBlockBase() = default;
+    explicit ControlBlockBase(const ControlBlockOps<Policy>* ops) : ops_(ops) {
+        if constexpr (kBindsBlock<Policy>) {
+            counts_.Bind(this);
+        }
+    }
+
+    void DeleteObject() {
+        if (ops_->destroy_object) {
+            ops_->destroy_object(this);
+        }
+    }
+    void* GetDeleter(const void* type) {
+        return ops_->get_deleter ? ops_->get_deleter(this, type) : nullptr;
+    }
+    // Identifies the block kind
+    const ControlBlockOps<Policy>* GetOps() const {
+        return ops_;
+    }
+    void Deallocate() {
+        ops_->deallocate(this);
+    }
 
-    virtual void DeleteObject() {
+    // Called once the block and its object are fully constructed
+    void OnCreated() {
+        if constexpr (kStatsEnabled) {
+            ops_->stats->Created();
+        }
     }
 
     void IncCounter() {
-        ++counter_;
+        if constexpr (kStatsEnabled) {
+            ops_->stats->StrongIncs(1);
+        }
+        counts_.IncStrong();
+    }
+    bool IncCounterIfNonZero() {
+        bool result = counts_.IncStrongIfNonZero();
+        if constexpr (kStatsEnabled) {
+            ops_->stats->StrongIncs(result ? 1 : 0);
+        }
+        return result;
     }
     void DecCounter() {
-        --counter_;
-        if (counter_ == 0) {
-            if (weak_counter_ == 0) {
-                delete this;
-            } else {
-                DeleteObject();
+        if constexpr (kStatsEnabled) {
+            ops_->stats->StrongDecs(1);
+        }
+        ReleaseHanded();
+    }
+    // Drops a reference whose release is already recorded, for policies that finish releases
+    // handed over to them by another thread
+    void ReleaseHanded() {
+        if constexpr (kCycleCollectorEnabled) {
+            if (IsTraced()) {
+                ReleaseTraced(1);
+                return;
+            }
+        }
+        if (counts_.DecStrong() == 0) {
+            ReleaseLast();
+        }
+    }
+    // Take and drop `count` references with one update, for batches of pointers
+    void AddCounter(size_t count) {
+        if constexpr (kStatsEnabled) {
+            ops_->stats->StrongIncs(count);
+        }
+        counts_.AddStrong(count);
+    }
+    void SubCounter(size_t count) {
+        if constexpr (kStatsEnabled) {
+            ops_->stats->StrongDecs(count);
+        }
+        if constexpr (kCycleCollectorEnabled) {
+            if (IsTraced()) {
+                ReleaseTraced(count);
+                return;
             }
         }
+        if (counts_.SubStrong(count) == 0) {
+            ReleaseLast();
+        }
     }
     size_t GetCounter() const {
-        return counter_;
+        return counts_.GetStrong();
     }
 
     void IncWeakCounter() {
-        ++weak_counter_;
+        if constexpr (kStatsEnabled) {
+            ops_->stats->WeakInc();
+        }
+        counts_.IncWeak();
     }
     void DecWeakCounter() {
-        --weak_counter_;
-        if (weak_counter_ == 0) {
-            if (counter_ == 0) {
-                delete this;
-            }
+        if constexpr (kStatsEnabled) {
+            ops_->stats->WeakDec();
         }
+        ReleaseWeak();
     }
     size_t GetWeakCounter() const {
-        return weak_counter_;
+        size_t weak = counts_.GetWeak();
+        return counts_.GetStrong() == 0 ? weak : weak - 1;
+    }
+
+    // Drops the weak reference of a cycle candidate, see `ReleaseTraced`
+    void ReleaseCandidate() {
+        ReleaseWeak();
+    }
+
+    // Counting policy, for policies with operations of their own
+    Policy& GetCounts() {
+        return counts_;
+    }
+
+    // Passes the references held by the object to `tracer`, if its type opts in
+    void Trace(CycleTracer<Policy>& tracer) {
+        if constexpr (kCycleCollectorEnabled) {
+            if (ops_->trace) {
+                ops_->trace(this, tracer);
+            }
+        }
     }
 
 private:
-    size_t counter_ = 0;
-    size_t weak_counter_ = 0;
+    bool IsTraced() const {
+        if constexpr (kCycleCollectorEnabled) {
+            return ops_->trace != nullptr;
+        }
+        return false;
+    }
+
+    // References left after a decrement may all come from a cycle, so the block becomes a
+    // candidate for the collector. Another thread may free it as soon as the count drops,
+    // hence the weak reference the candidate holds is taken before. After the last decrement
+    // the strong owners' weak reference keeps the block, so the candidate's one is dropped
+    // before the release checks for weak pointers. The candidate's reference is not a weak
+    // pointer and stays out of the statistics.
+    void ReleaseTraced(size_t count) {
+        counts_.IncWeak();
+        if (counts_.SubStrong(count) == 0) {
+            counts_.DecWeak();
+            ReleaseLast();
+        } else {
+            CycleCollector<Policy>::AddCandidate(this);
+        }
+    }
+
+    void ReleaseLast() {
+        if constexpr (kDefersRelease<Policy>) {
+            if (DeferredRelease::Active()) {
+                DeferredRelease::Push(this, &FinishDeferred);
+                return;
+            }
+        }
+        ReleaseObject();
+    }
+    static void FinishDeferred(DeferredNode* node) {
+        static_cast<ControlBlockBase*>(node)->ReleaseObject();
+    }
+
+    // Finishes the release of the last strong reference
+    void ReleaseObject() {
+        DeleteObject();
+        // Without weak references nothing can reach the block any more, so the weak
+        // count shared by the strong owners can be dropped without writing it
+        bool pinned = counts_.GetWeak() != 1;
+        if constexpr (kStatsEnabled) {
+            ops_->stats->ObjectDestroyed(pinned, ops_->block_size);
+        }
+        if (pinned) {
+            ReleaseWeak();
+        } else {
+            Free(false);
+        }
+    }
+
+    // Drops a weak reference, the last one is only left after the object was destroyed
+    void ReleaseWeak() {
+        if (counts_.DecWeak() == 0) {
+            Free(true);
+        }
+    }
+    void Free([[maybe_unused]] bool pinned) {
+        if constexpr (kStatsEnabled) {
+            ops_->stats->Freed(pinned, ops_->block_size);
+        }
+        Deallocate();
+    }
+
+    const ControlBlockOps<Policy>* ops_;
+    Policy counts_;
 };
 
-template <typename T>
-struct ControlBlockPtr : public ControlBlockBase {
+template <typename T, typename Policy, typename Deleter = Slug<T>,
+          typename Alloc = DefaultBlockAlloc<T>>
+struct ControlBlockPtr : public ControlBlockBase<Policy> {
+    using BlockAlloc =
+        typename std::allocator_traits<Alloc>::template rebind_alloc<ControlBlockPtr>;
+
 public:
-    ControlBlockPtr(T* other_ptr = nullptr) : ptr_(other_ptr) {
-        IncCounter();
-    }
-    ~ControlBlockPtr() override {
-        delete ptr_;
+    ControlBlockPtr(const Alloc& alloc, T* other_ptr, Deleter deleter)
+        : ControlBlockBase<Policy>(Ops()),
+          pair_(other_ptr,
+                CompressedPair<Deleter, BlockAlloc>(std::move(deleter), BlockAlloc(alloc))) {
     }
     T* GetPointer() const {
-        return ptr_;
+        return pair_.GetFirst();
     }
 
-    void DeleteObject() override {
-        delete ptr_;
-        ptr_ = nullptr;
+private:
+    static const ControlBlockOps<Policy>* Ops() {
+        static constexpr ControlBlockOps<Policy> kOps = MakeBlockOps<T, Policy>(
+            &DestroyObject, &Deallocate, &GetDeleter,
+            kTraceable<T, Policy> ? &TraceObject : nullptr, sizeof(ControlBlockPtr));
+        return &kOps;
     }
 
-private:
-    T* ptr_;
+    static void TraceObject(ControlBlockBase<Policy>* base, CycleTracer<Policy>& tracer) {
+        if constexpr (kTraceable<T, Policy>) {
+            static_cast<ControlBlockPtr*>(base)->GetPointer()->TraceRefs(tracer);
+        }
+    }
+
+    static void DestroyObject(ControlBlockBase<Policy>* base) {
+        auto* self = static_cast<ControlBlockPtr*>(base);
+        self->pair_.GetSecond().GetFirst()(self->pair_.GetFirst());
+    }
+    static void Deallocate(ControlBlockBase<Policy>* base) {
+        auto* self = static_cast<ControlBlockPtr*>(base);
+        BlockAlloc alloc(self->pair_.GetSecond().GetSecond());
+        self->~ControlBlockPtr();
+        std::allocator_traits<BlockAlloc>::deallocate(alloc, self, 1);
+    }
+    static void* GetDeleter(ControlBlockBase<Policy>* base, const void* type) {
+        auto* self = static_cast<ControlBlockPtr*>(base);
+        return type == &TypeTag<Deleter>::kId ? &self->pair_.GetSecond().GetFirst() : nullptr;
+    }
+
+    // Empty deleters and allocators take no space
+    CompressedPair<T*, CompressedPair<Deleter, BlockAlloc>> pair_;
 };
 
+// Requests default-initialization instead of value-initialization, see
+// `MakeSharedForOverwrite`
+struct ForOverwriteTag {};
+
+// Raw bytes for an object constructed in place, copying them is never meaningful
 template <typename T>
-struct ControlBlockObject : public ControlBlockBase {
+struct ObjectStorage {
+    ObjectStorage() {
+    }
+    ObjectStorage(const ObjectStorage&) {
+    }
+
+    alignas(T) std::array<char, sizeof(T)> bytes;
+};
+
+template <typename T, typename Policy, typename Alloc = DefaultBlockAlloc<T>>
+struct ControlBlockObject : public ControlBlockBase<Policy> {
+    using BlockAlloc =
+        typename std::allocator_traits<Alloc>::template rebind_alloc<ControlBlockObject>;
+
 public:
     template <typename... Args>
-    ControlBlockObject(Args&&... args) {
-        new (&storage_) T(std::forward<Args>(args)...);
-        IncCounter();
+    ControlBlockObject(const Alloc& alloc, Args&&... args)
+        : ControlBlockBase<Policy>(Ops()), pair_(BlockAlloc(alloc), ObjectStorage<T>()) {
+        new (&pair_.GetSecond().bytes) T(std::forward<Args>(args)...);
     }
-    ~ControlBlockObject() {
-        reinterpret_cast<T*>(&storage_)->~T();
+    ControlBlockObject(const Alloc& alloc, ForOverwriteTag)
+        : ControlBlockBase<Policy>(Ops()), pair_(BlockAlloc(alloc), ObjectStorage<T>()) {
+        new (&pair_.GetSecond().bytes) T;
     }
     T* GetPointer() {
-        return reinterpret_cast<T*>(&storage_);
+        return reinterpret_cast<T*>(&pair_.GetSecond().bytes);
     }
+    static bool IsKindOf(const ControlBlockBase<Policy>* block) {
+        return block->GetOps() == Ops();
+    }
+
+private:
+    static const ControlBlockOps<Policy>* Ops() {
+        static constexpr ControlBlockOps<Policy> kOps = MakeBlockOps<T, Policy>(
+            std::is_trivially_destructible_v<T> ? nullptr : &DestroyObject, &Deallocate, nullptr,
+            kTraceable<T, Policy> ? &TraceObject : nullptr, sizeof(ControlBlockObject));
+        return &kOps;
+    }
+
+    static void TraceObject(ControlBlockBase<Policy>* base, CycleTracer<Policy>& tracer) {
+        if constexpr (kTraceable<T, Policy>) {
+            static_cast<ControlBlockObject*>(base)->GetPointer()->TraceRefs(tracer);
+        }
+    }
+
+    static void DestroyObject(ControlBlockBase<Policy>* base) {
+        static_cast<ControlBlockObject*>(base)->GetPointer()->~T();
+    }
+    static void Deallocate(ControlBlockBase<Policy>* base) {
+        auto* self = static_cast<ControlBlockObject*>(base);
+        BlockAlloc alloc(self->pair_.GetFirst());
+        self->~ControlBlockObject();
+        std::allocator_traits<BlockAlloc>::deallocate(alloc, self, 1);
+    }
+
+    CompressedPair<BlockAlloc, ObjectStorage<T>> pair_;
+};
+
+// Block for `MakeShared<T[]>`, the elements follow the header in the same allocation and
+// start on a `kAlignment` boundary so vectorized code can use aligned loads
+template <typename T, typename Policy, typename Alloc = DefaultBlockAlloc<T>>
+struct ControlBlockArray : public ControlBlockBase<Policy> {
+    static_assert(!std::is_array_v<T>, "multidimensional arrays are not supported");
 
-    void DeleteObject() override {
-        reinterpret_cast<T*>(&storage_)->~T();
-        storage_.fill(0);
+public:
+    static constexpr size_t kAlignment = alignof(T) > 64 ? alignof(T) : 64;
+
+    struct alignas(kAlignment) Chunk {
+        char bytes[kAlignment];
+    };
+    using ChunkAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<Chunk>;
+
+    // Allocates a block for `size` elements and constructs them in order with
+    // `construct(T*)`, elements that were already built are destroyed if one throws
+    template <typename Construct>
+    static ControlBlockArray* Create(const Alloc& alloc, size_t size, Construct construct) {
+        ChunkAlloc chunk_alloc(alloc);
+        Chunk* chunks = std::allocator_traits<ChunkAlloc>::allocate(chunk_alloc, ChunkCount(size));
+        ControlBlockArray* block = new (chunks) ControlBlockArray(chunk_alloc, size);
+        T* elements = block->GetPointer();
+        size_t built = 0;
+        try {
+            for (; built < size; ++built) {
+                construct(elements + built);
+            }
+        } catch (...) {
+            block->Destroy(built);
+            block->~ControlBlockArray();
+            std::allocator_traits<ChunkAlloc>::deallocate(chunk_alloc, chunks, ChunkCount(size));
+            throw;
+        }
+        block->OnCreated();
+        return block;
+    }
+
+    T* GetPointer() {
+        return reinterpret_cast<T*>(reinterpret_cast<char*>(this) + HeaderSize());
     }
 
 private:
-    alignas(T) std::array<char, sizeof(T)> storage_;
+    ControlBlockArray(const ChunkAlloc& alloc, size_t size)
+        : ControlBlockBase<Policy>(Ops()), pair_(alloc, size) {
+    }
+
+    static const ControlBlockOps<Policy>* Ops() {
+        static constexpr ControlBlockOps<Policy> kOps = MakeBlockOps<T, Policy>(
+            std::is_trivially_destructible_v<T> ? nullptr : &DestroyObject, &Deallocate, nullptr,
+            nullptr, HeaderSize());
+        return &kOps;
+    }
+
+    static void DestroyObject(ControlBlockBase<Policy>* base) {
+        auto* self = static_cast<ControlBlockArray*>(base);
+        self->Destroy(self->pair_.GetSecond());
+    }
+    static void Deallocate(ControlBlockBase<Policy>* base) {
+        auto* self = static_cast<ControlBlockArray*>(base);
+        ChunkAlloc alloc(self->pair_.GetFirst());
+        size_t chunks = ChunkCount(self->pair_.GetSecond());
+        Chunk* memory = reinterpret_cast<Chunk*>(self);
+        self->~ControlBlockArray();
+        std::allocator_traits<ChunkAlloc>::deallocate(alloc, memory, chunks);
+    }
+
+    static constexpr size_t HeaderSize() {
+        return (sizeof(ControlBlockArray) + kAlignment - 1) / kAlignment * kAlignment;
+    }
+    static size_t ChunkCount(size_t size) {
+        return (HeaderSize() + size * sizeof(T) + kAlignment - 1) / kAlignment;
+    }
+
+    // Elements are destroyed in the reverse order of construction
+    void Destroy(size_t count) {
+        T* elements = GetPointer();
+        while (count != 0) {
+            elements[--count].~T();
+        }
+    }
+
+    // Allocator and number of elements
+    CompressedPair<ChunkAlloc, size_t> pair_;
+};
+
+// Allocates a control block through `alloc` rebound to the block type, the block keeps a
+// copy of the allocator to free itself with
+template <typename Block, typename Alloc, typename... Args>
+Block* AllocateControlBlock(const Alloc& alloc, Args&&... args) {
+    using BlockAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<Block>;
+    BlockAlloc block_alloc(alloc);
+    Block* block = std::allocator_traits<BlockAlloc>::allocate(block_alloc, 1);
+    try {
+        new (block) Block(alloc, std::forward<Args>(args)...);
+    } catch (...) {
+        std::allocator_traits<BlockAlloc>::deallocate(block_alloc, block, 1);
+        throw;
+    }
+    block->OnCreated();
+    return block;
+}
+
+// Block sizes per counting policy, e.g. `ControlBlockSizes<CompactCounting>::kObject<int>`
+template <typename Policy>
+struct ControlBlockSizes {
+    // Hook table pointer and counts, in front of every block
+    static constexpr size_t kHeader = sizeof(ControlBlockBase<Policy>);
+    // Deferred release queue link, part of the header
+    static constexpr size_t kLink = kDefersRelease<Policy> ? sizeof(DeferredNode) : 0;
+    // `SharedPtr(T*)` with the default deleter
+    template <typename T>
+    static constexpr size_t kPointer = sizeof(ControlBlockPtr<T, Policy>);
+    // `MakeShared<T>()`
+    template <typename T>
+    static constexpr size_t kObject = sizeof(ControlBlockObject<T, Policy>);
 };
 
+// The compact layout saves a word in front of every object. Builds that defer releases add
+// the queue link to the header of thread-safe blocks.
+static_assert(sizeof(void*) != 8 || ControlBlockSizes<CompactCounting>::kHeader ==
+                                        16 + ControlBlockSizes<CompactCounting>::kLink);
+static_assert(sizeof(void*) != 8 || ControlBlockSizes<CompactCounting>::kPointer<int> ==
+                                        24 + ControlBlockSizes<CompactCounting>::kLink);
+static_assert(sizeof(void*) != 8 || ControlBlockSizes<CompactCounting>::kObject<int64_t> ==
+                                        24 + ControlBlockSizes<CompactCounting>::kLink);
+static_assert(sizeof(void*) != 8 || ControlBlockSizes<AtomicCounting>::kObject<int64_t> ==
+                                        32 + ControlBlockSizes<AtomicCounting>::kLink);
+static_assert(sizeof(void*) != 8 || ControlBlockSizes<LocalCounting>::kObject<int64_t> == 32);
+
 class BadWeakPtr : public std::exception {};
 
-template <typename T>
+// Pointer conversions accepted by the constructors, as for `std::shared_ptr`. A `Y*` can be
+// owned as `T` if it converts to `T*`, for arrays `Y(*)[N]` or `Y(*)[]` has to convert to `T*`
+// instead, so that `new Derived[n]` is never owned as an array of `Base`.
+template <typename Y, typename T>
+inline constexpr bool kOwnableAs = std::is_convertible_v<Y*, T*>;
+template <typename Y, typename U>
+inline constexpr bool kOwnableAs<Y, U[]> = std::is_convertible_v<Y (*)[], U (*)[]>;
+template <typename Y, typename U, size_t N>
+inline constexpr bool kOwnableAs<Y, U[N]> = std::is_convertible_v<Y (*)[N], U (*)[N]>;
+
+// A pointer to `Y` can be shared as a pointer to `T` if `Y*` converts to `T*`, or if `Y` is
+// `U[N]` and `T` is `U[]`
+template <typename Y, typename T>
+inline constexpr bool kCompatible = std::is_convertible_v<Y*, T*>;
+template <typename U, size_t N, typename V>
+inline constexpr bool kCompatible<U[N], V[]> = std::is_convertible_v<U (*)[N], V (*)[N]>;
+
+template <typename T, typename Policy = DefaultCounting>
 class SharedPtr;
 
-template <typename T>
+template <typename T, typename Policy = DefaultCounting>
 class WeakPtr;
 
 class ESFTBase {};
 
-template <typename T>
+template <typename T, typename Policy = DefaultCounting>
 class EnableSharedFromThis;
+
+template <typename T, typename Policy = DefaultCounting>
+class AtomicSharedPtr;
+
+template <typename T, typename Policy = DefaultCounting>
+class AtomicWeakPtr;
+
+template <typename T, typename Policy = DefaultCounting>
+class ThinSharedPtr;
+
+template <typename T, typename Policy = DefaultCounting>
+class SharedRef;
+
+template <typename Policy = DefaultCounting>
+class SharedPtrBatch;
+
+template <typename T>
+class ShardedOwner;
+
+// Traced releases record candidates with the collector
+#ifdef SMART_POINTERS_CYCLE_COLLECTOR
+#include "cycle.h"
+#endif
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "shared.h"
+#include "weak.h"
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+// Thrown when a `SharedPtr` that does not own a `MakeShared` object is made thin
+class BadThinPtr : public std::exception {};
+
+// Owning pointer one word wide for objects created by `MakeShared`. It keeps the address of
+// the control block, the object lies at a fixed offset inside it. Copies share ownership
+// with the `SharedPtr`-s and `WeakPtr`-s of the same object.
+template <typename T, typename Policy>
+class ThinSharedPtr {
+    static_assert(!std::is_array_v<T>, "arrays are not supported");
+
+    using Block = ControlBlockObject<T, Policy, DefaultBlockAlloc<T>>;
+
+    template <typename Y, typename P>
+    friend class WeakPtr;
+
+public:
+    // Constructors
+
+    ThinSharedPtr() : block_(nullptr) {
+    }
+    ThinSharedPtr(std::nullptr_t) : block_(nullptr) {
+    }
+
+    ThinSharedPtr(const ThinSharedPtr& other) : block_(other.block_) {
+        if (block_) {
+            block_->IncCounter();
+        }
+    }
+    ThinSharedPtr(ThinSharedPtr&& other) noexcept : block_(other.block_) {
+        other.block_ = nullptr;
+    }
+
+    // `other` must be empty or point to the object of a `MakeShared<T>` block, otherwise
+    // `BadThinPtr` is thrown
+    explicit ThinSharedPtr(const SharedPtr<T, Policy>& other) : block_(FromShared(other)) {
+        if (block_) {
+            block_->IncCounter();
+        }
+    }
+    explicit ThinSharedPtr(SharedPtr<T, Policy>&& other) : block_(FromShared(other)) {
+        other.block_ = nullptr;
+        other.ptr_ = nullptr;
+    }
+
+    // Promotes `WeakPtr`, throws `BadWeakPtr` if the object is gone
+    explicit ThinSharedPtr(const WeakPtr<T, Policy>& other)
+        : ThinSharedPtr(SharedPtr<T, Policy>(other)) {
+    }
+
+    // `operator=`-s
+
+    ThinSharedPtr& operator=(const ThinSharedPtr& other) {
+        ThinSharedPtr(other).Swap(*this);
+        return *this;
+    }
+    ThinSharedPtr& operator=(ThinSharedPtr&& other) noexcept {
+        ThinSharedPtr(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    // Destructor
+
+    ~ThinSharedPtr() {
+        if (block_) {
+            block_->DecCounter();
+        }
+    }
+
+    // Conversions
+
+    operator SharedPtr<T, Policy>() const& {
+        if (!block_) {
+            return SharedPtr<T, Policy>();
+        }
+        block_->IncCounter();
+        return SharedPtr<T, Policy>(typename SharedPtr<T, Policy>::AdoptRef(), block_, Get());
+    }
+    operator SharedPtr<T, Policy>() && {
+        if (!block_) {
+            return SharedPtr<T, Policy>();
+        }
+        T* ptr = Get();
+        return SharedPtr<T, Policy>(typename SharedPtr<T, Policy>::AdoptRef(),
+                                    std::exchange(block_, nullptr), ptr);
+    }
+
+    // Modifiers
+
+    void Reset() {
+        ThinSharedPtr().Swap(*this);
+    }
+    void Swap(ThinSharedPtr& other) noexcept {
+        std::swap(block_, other.block_);
+    }
+
+    // Observers
+
+    T* Get() const {
+        return block_ ? block_->GetPointer() : nullptr;
+    }
+    T& operator*() const {
+        return *block_->GetPointer();
+    }
+    T* operator->() const {
+        return block_->GetPointer();
+    }
+    size_t UseCount() const {
+        return block_ ? block_->GetCounter() : 0;
+    }
+    explicit operator bool() const {
+        return block_ != nullptr;
+    }
+
+private:
+    static Block* FromShared(const SharedPtr<T, Policy>& other) {
+        if (!other.block_) {
+            return nullptr;
+        }
+        if (!Block::IsKindOf(other.block_)) {
+            throw BadThinPtr();
+        }
+        auto* block = static_cast<Block*>(other.block_);
+        if (block->GetPointer() != other.ptr_) {
+            throw BadThinPtr();
+        }
+        return block;
+    }
+
+    Block* block_;
+};
+
+static_assert(sizeof(ThinSharedPtr<int>) == sizeof(void*));
+
+template <typename T, typename Policy>
+struct IsTriviallyRelocatable<ThinSharedPtr<T, Policy>> : std::true_type {};
+
+template <typename T, typename U, typename Policy>
+inline bool operator==(const ThinSharedPtr<T, Policy>& left,
+                       const ThinSharedPtr<U, Policy>& right) {
+    return left.Get() == right.Get();
+}
+
+template <typename T, typename Policy, typename... Args>
+ThinSharedPtr<T, Policy> MakeThinSharedWithPolicy(Args&&... args) {
+    return ThinSharedPtr<T, Policy>(MakeSharedWithPolicy<T, Policy>(std::forward<Args>(args)...));
+}
+
+template <typename T, typename... Args>
+ThinSharedPtr<T> MakeThinShared(Args&&... args) {
+    return MakeThinSharedWithPolicy<T, DefaultCounting>(std::forward<Args>(args)...);
+}
@@ -2,14 +2,22 @@
 
 #include "sw_fwd.h"
 
-template <typename T>
+#include <cstddef>
+#include <functional>
+
+template <typename T, typename Policy>
 class WeakPtr {
-    template <typename Y>
+    using ElementType = std::remove_extent_t<T>;
+
+    template <typename Y, typename P>
     friend class WeakPtr;
 
-    template <typename Y>
+    template <typename Y, typename P>
     friend class SharedPtr;
 
+    template <typename Y, typename P>
+    friend class AtomicWeakPtr;
+
 public:
     // Constructors
 
@@ -21,27 +29,38 @@ public:
             block_->IncWeakCounter();
         }
     }
-    WeakPtr(WeakPtr&& other) : block_(other.block_), ptr_(other.ptr_) {
+    WeakPtr(WeakPtr&& other) noexcept : block_(other.block_), ptr_(other.ptr_) {
         other.block_ = nullptr;
         other.ptr_ = nullptr;
     }
 
-    template <typename Y>
-    WeakPtr(const WeakPtr<Y>& other) : block_(other.block_), ptr_(static_cast<T*>(other.ptr_)) {
+    template <typename Y, typename = std::enable_if_t<kCompatible<Y, T>>>
+    WeakPtr(const WeakPtr<Y, Policy>& other)
+        : block_(other.block_), ptr_(other.ptr_) {
         if (block_) {
             block_->IncWeakCounter();
         }
     }
-    template <typename Y>
-    WeakPtr(WeakPtr<Y>&& other) : block_(other.block_), ptr_(static_cast<T*>(other.ptr_)) {
+    template <typename Y, typename = std::enable_if_t<kCompatible<Y, T>>>
+    WeakPtr(WeakPtr<Y, Policy>&& other) noexcept
+        : block_(other.block_), ptr_(other.ptr_) {
         other.block_ = nullptr;
         other.ptr_ = nullptr;
     }
 
     // Demote `SharedPtr`
     // #2 from https://en.cppreference.com/w/cpp/memory/weak_ptr/weak_ptr
-    template <typename Y>
-    WeakPtr(const SharedPtr<Y>& other) : block_(other.block_), ptr_(static_cast<T*>(other.ptr_)) {
+    template <typename Y, typename = std::enable_if_t<kCompatible<Y, T>>>
+    WeakPtr(const SharedPtr<Y, Policy>& other)
+        : block_(other.block_), ptr_(other.ptr_) {
+        if (block_) {
+            block_->IncWeakCounter();
+        }
+    }
+
+    template <typename Y, typename = std::enable_if_t<kCompatible<Y, T>>>
+    WeakPtr(const ThinSharedPtr<Y, Policy>& other)
+        : block_(other.block_), ptr_(other.Get()) {
         if (block_) {
             block_->IncWeakCounter();
         }
@@ -63,18 +82,8 @@ public:
         }
         return *this;
     }
-    WeakPtr& operator=(WeakPtr&& other) {
-        if (&other == this) {
-            return *this;
-        }
-        if (block_) {
-            block_->DecWeakCounter();
-        }
-        block_ = other.block_;
-        ptr_ = other.ptr_;
-
-        other.block_ = nullptr;
-        other.ptr_ = nullptr;
+    WeakPtr& operator=(WeakPtr&& other) noexcept {
+        WeakPtr(std::move(other)).Swap(*this);
         return *this;
     }
 
@@ -97,10 +106,12 @@ public:
         block_ = nullptr;
         ptr_ = nullptr;
     }
-    void Swap(WeakPtr& other) {
-        ControlBlockBase* tmp = block_;
+    void Swap(WeakPtr& other) noexcept {
+        ControlBlockBase<Policy>* tmp = block_;
         block_ = other.block_;
         other.block_ = tmp;
+
+        std::swap(ptr_, other.ptr_);
     }
 
     // Observers
@@ -114,11 +125,39 @@ public:
     bool Expired() const {
         return UseCount() == 0;
     }
-    SharedPtr<T> Lock() const {
-        return Expired() ? SharedPtr<T>() : SharedPtr<T>(*this);
+    SharedPtr<T, Policy> Lock() const {
+        if (block_ && block_->IncCounterIfNonZero()) {
+            return SharedPtr<T, Policy>(typename SharedPtr<T, Policy>::AdoptRef(), block_, ptr_);
+        }
+        return SharedPtr<T, Policy>();
+    }
+
+    // Owner-based ordering and hashing: pointers sharing a control block are equivalent,
+    // whatever they point to and even after the object expired
+    template <typename Y>
+    bool OwnerBefore(const SharedPtr<Y, Policy>& other) const {
+        return std::less<const void*>()(block_, other.block_);
+    }
+    template <typename Y>
+    bool OwnerBefore(const WeakPtr<Y, Policy>& other) const {
+        return std::less<const void*>()(block_, other.block_);
+    }
+    template <typename Y>
+    bool OwnerEquals(const SharedPtr<Y, Policy>& other) const {
+        return block_ == other.block_;
+    }
+    template <typename Y>
+    bool OwnerEquals(const WeakPtr<Y, Policy>& other) const {
+        return block_ == other.block_;
+    }
+    size_t OwnerHash() const {
+        return std::hash<const void*>()(block_);
     }
 
 private:
-    ControlBlockBase* block_;
-    T* ptr_;
+    ControlBlockBase<Policy>* block_;
+    ElementType* ptr_;
 };
+
+template <typename T, typename Policy>
+struct IsTriviallyRelocatable<WeakPtr<T, Policy>> : std::true_type {};
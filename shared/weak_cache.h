@@ -0,0 +1,241 @@
+#pragma once
+
+#include "shared.h"
+#include "weak.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+// Thrown by `WeakCache::Get` when a loader asks for the key it is loading, directly or through
+// the loaders of other keys, since waiting for itself would never return
+class BadRecursiveLoad : public std::exception {};
+
+// Deduplicating cache of shared immutable values that does not keep them alive.
+//
+// Entries hold `WeakPtr`-s, so a value stays cached exactly as long as someone uses it and
+// `Get` hands out the same object to everyone in the meantime. Keys are spread over
+// `kShardCount` independently locked shards. Concurrent misses on one key run the loader
+// once: the first caller loads outside the lock while the others wait for its result.
+// Entries of expired values are removed lazily, a few buckets of a shard on every insertion
+// into it, or all at once by `Sweep`.
+//
+// A loader may get other keys from the cache, unless that makes it wait for its own key: on
+// the loading thread this throws `BadRecursiveLoad`, loaders on different threads waiting for
+// each other deadlock.
+template <typename K, typename V, typename Hash = std::hash<K>,
+          typename KeyEqual = std::equal_to<K>, typename Policy = DefaultCounting>
+class WeakCache {
+    static_assert(!std::is_same_v<Policy, LocalCounting>,
+                  "WeakCache shares values between threads and needs thread-safe counting");
+
+public:
+    static constexpr size_t kShardBits = 4;
+    static constexpr size_t kShardCount = size_t(1) << kShardBits;
+    // Buckets of a shard checked for expired entries per insertion
+    static constexpr size_t kSweepBuckets = 2;
+
+    WeakCache() = default;
+
+    WeakCache(const WeakCache&) = delete;
+    WeakCache& operator=(const WeakCache&) = delete;
+
+    // Value cached for `key`, or the one returned by `loader(key)` if there is no live one.
+    // A loader that throws leaves no entry, its exception reaches every caller waiting for it.
+    // Throws `BadRecursiveLoad` if the calling thread is loading `key` already.
+    template <typename Loader>
+    SharedPtr<V, Policy> Get(const K& key, Loader&& loader) {
+        Shard& shard = ShardOf(key);
+        LoadPtr load;
+        bool loading = false;
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto [it, inserted] = shard.entries.try_emplace(key);
+            Entry& entry = it->second;
+            if (SharedPtr<V, Policy> value = entry.value.Lock()) {
+                return value;
+            }
+            load = entry.load;
+            if (!load) {
+                load = MakeSharedWithPolicy<Load, AtomicCounting>();
+                entry.load = load;
+                loading = true;
+                if (inserted) {
+                    // Keeps the new entry, whose load is pending
+                    shard.SweepSome();
+                }
+            }
+        }
+        if (loading) {
+            return RunLoader(shard, key, std::move(load), std::forward<Loader>(loader));
+        }
+        if (load->IsLoader()) {
+            throw BadRecursiveLoad();
+        }
+        return load->Wait();
+    }
+
+    // Live value cached for `key`, without loading one
+    SharedPtr<V, Policy> Find(const K& key) const {
+        const Shard& shard = ShardOf(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        return it == shard.entries.end() ? SharedPtr<V, Policy>() : it->second.value.Lock();
+    }
+
+    // Removes the entries of every expired value, returns how many
+    size_t Sweep() {
+        size_t removed = 0;
+        for (Shard& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for (size_t bucket = 0; bucket < shard.entries.bucket_count(); ++bucket) {
+                removed += shard.SweepBucket(bucket);
+            }
+        }
+        return removed;
+    }
+
+    // Entries, including the expired ones not removed yet
+    size_t Size() const {
+        size_t size = 0;
+        for (const Shard& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            size += shard.entries.size();
+        }
+        return size;
+    }
+
+private:
+    // Result of one loader call, shared by the callers that wait for it
+    class Load {
+    public:
+        Load() : loader_(std::this_thread::get_id()) {
+        }
+
+        // Whether the calling thread runs the loader
+        bool IsLoader() const {
+            return loader_ == std::this_thread::get_id();
+        }
+
+        void Finish(SharedPtr<V, Policy> value, std::exception_ptr error) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                value_ = std::move(value);
+                error_ = std::move(error);
+                done_ = true;
+            }
+            done_changed_.notify_all();
+        }
+
+        SharedPtr<V, Policy> Wait() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            done_changed_.wait(lock, [this] { return done_; });
+            if (error_) {
+                std::rethrow_exception(error_);
+            }
+            return value_;
+        }
+
+    private:
+        const std::thread::id loader_;
+        std::mutex mutex_;
+        std::condition_variable done_changed_;
+        bool done_ = false;
+        SharedPtr<V, Policy> value_;
+        std::exception_ptr error_;
+    };
+    // Waiters may outlive the entry, which is why loads are shared
+    using LoadPtr = SharedPtr<Load, AtomicCounting>;
+
+    struct Entry {
+        bool IsExpired() const {
+            return !load && value.Expired();
+        }
+
+        WeakPtr<V, Policy> value;
+        // Set while the loader runs
+        LoadPtr load;
+    };
+
+    struct Shard {
+        // Removes the expired entries of the next few buckets
+        void SweepSome() {
+            for (size_t i = 0; i < kSweepBuckets; ++i) {
+                SweepBucket(cursor++ % entries.bucket_count());
+            }
+        }
+
+        size_t SweepBucket(size_t bucket) {
+            size_t removed = 0;
+            // Erasing invalidates the bucket's iterators, so the scan restarts after every
+            // removal; buckets hold about one entry
+            for (auto it = entries.begin(bucket); it != entries.end(bucket);) {
+                if (it->second.IsExpired()) {
+                    entries.erase(entries.find(it->first));
+                    ++removed;
+                    it = entries.begin(bucket);
+                } else {
+                    ++it;
+                }
+            }
+            return removed;
+        }
+
+        mutable std::mutex mutex;
+        std::unordered_map<K, Entry, Hash, KeyEqual> entries;
+        size_t cursor = 0;
+    };
+
+    // Runs the loader outside the shard lock and publishes its result to the entry and to
+    // the waiting callers
+    template <typename Loader>
+    SharedPtr<V, Policy> RunLoader(Shard& shard, const K& key, LoadPtr load, Loader&& loader) {
+        SharedPtr<V, Policy> value;
+        std::exception_ptr error;
+        try {
+            value = std::forward<Loader>(loader)(key);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.entries.find(key);
+            if (it != shard.entries.end() && it->second.load.OwnerEquals(load)) {
+                if (error) {
+                    shard.entries.erase(it);
+                } else {
+                    it->second.value = value;
+                    it->second.load.Reset();
+                }
+            }
+        }
+        load->Finish(value, error);
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return value;
+    }
+
+    Shard& ShardOf(const K& key) {
+        return shards_[ShardIndex(key)];
+    }
+    const Shard& ShardOf(const K& key) const {
+        return shards_[ShardIndex(key)];
+    }
+    // Fibonacci hashing takes the shard from the high bits, the buckets of the shard's map
+    // use the low ones
+    size_t ShardIndex(const K& key) const {
+        uint64_t hash = static_cast<uint64_t>(hash_(key));
+        return static_cast<size_t>((hash * 0x9E3779B97F4A7C15ull) >> (64 - kShardBits));
+    }
+
+    Hash hash_;
+    Shard shards_[kShardCount];
+};
@@ -0,0 +1,108 @@
+#include "shared/shared.h"
+#include "shared/weak.h"
+#include "check.h"
+
+#include <string>
+#include <type_traits>
+#include <vector>
+
+struct Base {
+    int value = 0;
+};
+struct Derived : Base {};
+
+// Arrays convert only to arrays of the same element type
+static_assert(std::is_constructible_v<SharedPtr<Base>, Derived*>);
+static_assert(std::is_constructible_v<SharedPtr<Base[]>, Base*>);
+static_assert(std::is_constructible_v<SharedPtr<Base[2]>, Base*>);
+static_assert(!std::is_constructible_v<SharedPtr<Base[]>, Derived*>);
+static_assert(!std::is_constructible_v<SharedPtr<Base[2]>, Derived*>);
+static_assert(!std::is_constructible_v<SharedPtr<Base[]>, UniquePtr<Derived[]>>);
+static_assert(!std::is_constructible_v<SharedPtr<int>, UniquePtr<int[]>>);
+static_assert(std::is_constructible_v<SharedPtr<int[]>, SharedPtr<int[4]>>);
+static_assert(std::is_constructible_v<SharedPtr<const int[]>, SharedPtr<int[]>>);
+static_assert(!std::is_constructible_v<SharedPtr<int>, SharedPtr<int[]>>);
+static_assert(!std::is_constructible_v<SharedPtr<int[]>, SharedPtr<int>>);
+static_assert(!std::is_constructible_v<SharedPtr<int[4]>, SharedPtr<int[]>>);
+static_assert(!std::is_constructible_v<SharedPtr<Base[]>, SharedPtr<Derived[]>>);
+static_assert(!std::is_constructible_v<SharedPtr<Derived>, SharedPtr<Base>>);
+static_assert(!std::is_constructible_v<WeakPtr<int>, SharedPtr<int[]>>);
+
+// Records constructions as ids and destructions as `-id - 1`
+struct Tracked {
+    Tracked() : id(next++) {
+        if (id == throw_at) {
+            throw id;
+        }
+        order.push_back(id);
+    }
+    ~Tracked() {
+        order.push_back(-id - 1);
+    }
+
+    static void Reset(int throw_on = -1) {
+        order.clear();
+        next = 0;
+        throw_at = throw_on;
+    }
+
+    static inline std::vector<int> order;
+    static inline int next = 0;
+    static inline int throw_at = -1;
+
+    int id;
+};
+
+void TestOrder() {
+    Tracked::Reset();
+    MakeShared<Tracked[]>(3).Reset();
+    CHECK((Tracked::order == std::vector<int>{0, 1, 2, -3, -2, -1}));
+
+    Tracked::Reset();
+    {
+        auto bounded = MakeShared<Tracked[2]>();
+        WeakPtr<Tracked[2]> weak = bounded;
+    }
+    CHECK((Tracked::order == std::vector<int>{0, 1, -2, -1}));
+}
+
+// The elements built before the throwing one are destroyed in reverse order
+void TestThrowingConstructor() {
+    Tracked::Reset(2);
+    bool thrown = false;
+    try {
+        MakeShared<Tracked[]>(4);
+    } catch (int id) {
+        thrown = id == 2;
+    }
+    CHECK(thrown);
+    CHECK((Tracked::order == std::vector<int>{0, 1, -2, -1}));
+
+    Tracked::Reset(0);
+    thrown = false;
+    try {
+        MakeShared<Tracked[3]>();
+    } catch (int) {
+        thrown = true;
+    }
+    CHECK(thrown && Tracked::order.empty());
+}
+
+void TestValues() {
+    auto numbers = MakeShared<int[]>(100);
+    for (int i = 0; i < 100; ++i) {
+        CHECK(numbers[i] == 0);
+    }
+    auto strings = MakeShared<std::string[]>(3, std::string(100, 'x'));
+    CHECK(strings[2].size() == 100);
+    auto bounded = MakeShared<std::string[5]>("y");
+    CHECK(bounded[4] == "y");
+    SharedPtr<std::string[]> unbounded = bounded;
+    CHECK(unbounded[0] == "y");
+}
+
+int main() {
+    TestOrder();
+    TestThrowingConstructor();
+    TestValues();
+}
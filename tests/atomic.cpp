@@ -0,0 +1,60 @@
+#include "shared/atomic.h"
+#include "check.h"
+
+#include <thread>
+#include <vector>
+
+struct Counter {
+    explicit Counter(int value) : value(value) {
+    }
+    int value;
+};
+
+// Every successful exchange replaces the value seen by the writer, so no increment is lost
+void TestCompareExchangeRace() {
+    constexpr int kThreads = 4;
+    constexpr int kIncrements = 20000;
+    AtomicSharedPtr<Counter> cell(MakeShared<Counter>(0));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < kIncrements; ++i) {
+                SharedPtr<Counter> expected = cell.Load();
+                SharedPtr<Counter> desired = MakeShared<Counter>(expected->value + 1);
+                while (!cell.CompareExchangeWeak(expected, desired)) {
+                    desired = MakeShared<Counter>(expected->value + 1);
+                }
+            }
+        });
+    }
+    threads.emplace_back([&] {
+        for (int i = 0; i < kIncrements; ++i) {
+            CHECK(cell.Load()->value >= 0);
+        }
+    });
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    SharedPtr<Counter> last = cell.Load();
+    CHECK(last->value == kThreads * kIncrements);
+    CHECK(last.UseCount() == 2);
+}
+
+void TestCompareExchangeStrong() {
+    AtomicSharedPtr<Counter> cell;
+    SharedPtr<Counter> first = MakeShared<Counter>(1);
+    SharedPtr<Counter> expected;
+    CHECK(cell.CompareExchangeStrong(expected, first));
+    CHECK(cell.Load().Get() == first.Get());
+
+    SharedPtr<Counter> wrong = MakeShared<Counter>(2);
+    CHECK(!cell.CompareExchangeStrong(wrong, nullptr));
+    CHECK(wrong.Get() == first.Get());
+    CHECK(cell.Exchange(nullptr).Get() == first.Get());
+    CHECK(first.UseCount() == 2);
+}
+
+int main() {
+    TestCompareExchangeRace();
+    TestCompareExchangeStrong();
+}
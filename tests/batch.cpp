@@ -0,0 +1,72 @@
+#include "shared/biased.h"
+#include "shared/shared.h"
+#include "check.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+static std::atomic<int> alive = 0;
+
+struct Object {
+    explicit Object(int value) : value(value) {
+        ++alive;
+    }
+    ~Object() {
+        --alive;
+    }
+    int value;
+};
+
+template <typename Policy>
+void TestCounts() {
+    using Ptr = SharedPtr<Object, Policy>;
+    std::vector<Ptr> objects;
+    for (int i = 0; i < 40; ++i) {
+        objects.push_back(MakeSharedWithPolicy<Object, Policy>(i));
+    }
+    std::vector<Ptr> source;
+    for (int i = 0; i < 10000; ++i) {
+        source.push_back(objects[i % 40]);
+    }
+    // The targets are constructed, the old value of one of them is released
+    std::vector<Ptr> target(source.size());
+    target[5] = MakeSharedWithPolicy<Object, Policy>(-1);
+
+    Ptr::CopyN(source.data(), source.size(), target.data());
+    CHECK(alive == 40);
+    for (const Ptr& object : objects) {
+        CHECK(object.UseCount() == 1 + 2 * 250);
+    }
+    for (size_t i = 0; i < target.size(); ++i) {
+        CHECK(target[i].Get() == source[i].Get());
+    }
+
+    Ptr::DestroyN(target.data(), target.size());
+    Ptr::DestroyN(source.data(), source.size());
+    for (const Ptr& object : objects) {
+        CHECK(object.UseCount() == 1);
+    }
+    objects.clear();
+    CHECK(alive == 0);
+}
+
+// `DestroyN` on a thread that does not own the biased blocks
+void TestForeignDestroy() {
+    using Ptr = SharedPtr<Object, BiasedCounting>;
+    Ptr object = MakeSharedWithPolicy<Object, BiasedCounting>(0);
+    std::vector<Ptr> copies(100, object);
+    std::thread([&] { Ptr::DestroyN(copies.data(), copies.size()); }).join();
+    // Until the owner takes the queued release, the block counts it
+    DrainBiasedQueue();
+    CHECK(object.UseCount() == 1);
+    object.Reset();
+    CHECK(alive == 0);
+}
+
+int main() {
+    TestCounts<AtomicCounting>();
+    TestCounts<LocalCounting>();
+    TestCounts<BiasedCounting>();
+    TestForeignDestroy();
+}
@@ -0,0 +1,97 @@
+// First, so the policy header builds on its own
+#include "shared/biased.h"
+#include "shared/weak.h"
+#include "check.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+static std::atomic<int> alive = 0;
+
+struct Object {
+    Object() {
+        ++alive;
+    }
+    ~Object() {
+        --alive;
+    }
+};
+
+using Ptr = SharedPtr<Object, BiasedCounting>;
+using Weak = WeakPtr<Object, BiasedCounting>;
+
+// Copies released by another thread are queued to the owner
+void TestForeignReleases() {
+    Ptr object = MakeSharedWithPolicy<Object, BiasedCounting>();
+    std::vector<Ptr> copies(100, object);
+    std::thread([&] { copies.clear(); }).join();
+    CHECK(alive == 1);
+    object.Reset();
+    CHECK(alive == 0);
+}
+
+// The last release happens on another thread while the owner lives, it is queued until the
+// owner drains its queue
+void TestForeignLastRelease() {
+    Ptr object = MakeSharedWithPolicy<Object, BiasedCounting>();
+    Weak weak = object;
+    std::thread releaser([copy = object]() mutable {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        copy.Reset();
+    });
+    object.Reset();
+    releaser.join();
+    CHECK(alive == 1);
+    DrainBiasedQueue();
+    CHECK(alive == 0 && weak.Expired());
+}
+
+// The owner thread is gone when the other threads release the object
+void TestExitedOwner() {
+    std::vector<Ptr> copies;
+    std::thread([&] {
+        Ptr object = MakeSharedWithPolicy<Object, BiasedCounting>();
+        copies.assign(10, object);
+    }).join();
+    Weak weak = copies[0];
+    std::thread([&] {
+        CHECK(weak.Lock());
+        copies.clear();
+    }).join();
+    CHECK(alive == 0 && weak.Expired());
+}
+
+void TestStress() {
+    for (int round = 0; round < 20; ++round) {
+        Ptr object = MakeSharedWithPolicy<Object, BiasedCounting>();
+        Weak weak = object;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([copy = object, weak]() mutable {
+                for (int i = 0; i < 1000; ++i) {
+                    Ptr local = copy;
+                    Ptr locked = weak.Lock();
+                    CHECK(locked);
+                }
+            });
+        }
+        for (int i = 0; i < 1000; ++i) {
+            Ptr local = object;
+        }
+        object.Reset();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        DrainBiasedQueue();
+        CHECK(alive == 0);
+    }
+}
+
+int main() {
+    TestForeignReleases();
+    TestForeignLastRelease();
+    TestExitedOwner();
+    TestStress();
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Stops the test at the first failed condition, unlike `assert` it is never compiled out
+#define CHECK(condition)                                                                   \
+    do {                                                                                   \
+        if (!(condition)) {                                                                \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,          \
+                         #condition);                                                      \
+            std::abort();                                                                  \
+        }                                                                                  \
+    } while (false)
+
+// Runs `body` in a child process and checks that it terminates the program
+template <typename Body>
+void CheckDies(Body body) {
+    std::fflush(nullptr);
+    pid_t child = fork();
+    CHECK(child != -1);
+    if (child == 0) {
+        // The child's diagnostics are expected
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDERR_FILENO);
+        body();
+        _exit(0);
+    }
+    int status = 0;
+    CHECK(waitpid(child, &status, 0) == child);
+    CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+}
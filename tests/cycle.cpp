@@ -0,0 +1,52 @@
+#include "shared/shared.h"
+#include "shared/weak.h"
+#include "check.h"
+
+static int alive = 0;
+
+struct Node {
+    Node() {
+        ++alive;
+    }
+    ~Node() {
+        --alive;
+    }
+    void TraceRefs(CycleTracer<>& tracer) {
+        tracer(next);
+    }
+    SharedPtr<Node> next;
+};
+
+void TestTwoNodeCycle() {
+    WeakPtr<Node> weak;
+    {
+        auto first = MakeShared<Node>();
+        auto second = MakeShared<Node>();
+        first->next = second;
+        second->next = first;
+        weak = first;
+    }
+    CHECK(alive == 2);
+    CHECK(CollectCycles() == 2);
+    CHECK(alive == 0 && weak.Expired());
+}
+
+// A cycle with a reference from outside is kept
+void TestReachableCycle() {
+    auto first = MakeShared<Node>();
+    {
+        auto second = MakeShared<Node>();
+        first->next = second;
+        second->next = first;
+    }
+    auto copy = first;
+    copy.Reset();
+    CHECK(CollectCycles() == 0 && alive == 2);
+    first.Reset();
+    CHECK(CollectCycles() == 2 && alive == 0);
+}
+
+int main() {
+    TestTwoNodeCycle();
+    TestReachableCycle();
+}
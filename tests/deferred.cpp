@@ -0,0 +1,76 @@
+#include "shared/shared.h"
+#include "shared/weak.h"
+#include "check.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+static std::atomic<int> alive = 0;
+
+struct Node {
+    Node() {
+        ++alive;
+    }
+    ~Node() {
+        --alive;
+    }
+    SharedPtr<Node> next;
+};
+
+// A deferred chain is destroyed by the drain, weak pointers see it expired before
+void TestDrain() {
+    SharedPtr<Node> head = MakeShared<Node>();
+    SharedPtr<Node> tail = head;
+    for (int i = 0; i < 1000; ++i) {
+        tail->next = MakeShared<Node>();
+        tail = tail->next;
+    }
+    tail.Reset();
+    WeakPtr<Node> weak = head;
+    size_t depth = GetDeferredStats().Depth();
+    ReleaseDeferred(head);
+    CHECK(alive == 1001 && weak.Expired());
+    CHECK(GetDeferredStats().Depth() == depth + 1);
+    CHECK(DrainDeferred() == 1);
+    CHECK(alive == 0);
+}
+
+// Thread-confined blocks are released by their thread even inside a scope
+void TestLocalCounting() {
+    auto local = MakeSharedWithPolicy<Node, LocalCounting>();
+    {
+        DeferredReleaseScope scope;
+        local.Reset();
+        CHECK(alive == 0);
+    }
+    CHECK(DrainDeferred() == 0);
+}
+
+void TestReclaimer() {
+    {
+        DeferredReclaimer reclaimer(std::chrono::microseconds(200));
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([] {
+                DeferredReleaseScope scope;
+                for (int i = 0; i < 10000; ++i) {
+                    auto node = MakeShared<Node>();
+                    node->next = MakeShared<Node>();
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+    CHECK(alive == 0);
+    DeferredStats stats = GetDeferredStats();
+    CHECK(stats.Depth() == 0 && stats.reclaimed == stats.deferred);
+}
+
+int main() {
+    TestDrain();
+    TestLocalCounting();
+    TestReclaimer();
+}
@@ -0,0 +1,101 @@
+#include "shared/shared_pool.h"
+#include "shared/weak.h"
+#include "check.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static std::atomic<int> alive = 0;
+
+struct Packet {
+    explicit Packet(int id) : id(id) {
+        ++alive;
+    }
+    ~Packet() {
+        --alive;
+    }
+    int id;
+    char payload[40] = {};
+};
+
+void TestReuse() {
+    WeakPtr<Packet> weak;
+    void* slot;
+    {
+        auto packet = SharedPool<Packet>::Make(1);
+        weak = packet;
+        slot = packet.Get();
+    }
+    // The weak pointer keeps the slot until it is released
+    CHECK(weak.Expired() && alive == 0);
+    weak.Reset();
+    auto packet = SharedPool<Packet>::Make(2);
+    CHECK(packet.Get() == slot && packet->id == 2);
+}
+
+// Producers allocate, a consumer drops the last references, slots move between threads
+void TestForeignReleases() {
+    std::vector<SharedPtr<Packet>> queue;
+    std::mutex mutex;
+    std::atomic<int> producing = 4;
+    std::thread consumer([&] {
+        while (true) {
+            bool done = producing == 0;
+            std::vector<SharedPtr<Packet>> local;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                local.swap(queue);
+            }
+            if (local.empty() && done) {
+                break;
+            }
+        }
+    });
+    std::vector<std::thread> producers;
+    for (int t = 0; t < 4; ++t) {
+        producers.emplace_back([&] {
+            for (int i = 0; i < 20000; ++i) {
+                auto packet = SharedPool<Packet>::Make(i);
+                std::lock_guard<std::mutex> lock(mutex);
+                queue.push_back(std::move(packet));
+            }
+            --producing;
+        });
+    }
+    for (std::thread& producer : producers) {
+        producer.join();
+    }
+    consumer.join();
+    CHECK(alive == 0);
+}
+
+struct Large {
+    char data[16 * 1024];
+};
+
+// A thread keeps at most two batches of large slots, the slots it frees serve other threads
+void TestLargeSlots() {
+    using Pool = SharedPool<Large>::Pool;
+    CHECK(Pool::BatchSize(0) == 1);
+    std::vector<SharedPtr<Large>> objects;
+    for (int i = 0; i < 64; ++i) {
+        objects.push_back(SharedPool<Large>::Make());
+    }
+    objects.clear();
+    size_t slab_bytes = SharedPool<Large>::GetStats().slab_bytes;
+    std::thread([] {
+        std::vector<SharedPtr<Large>> objects;
+        for (int i = 0; i < 64; ++i) {
+            objects.push_back(SharedPool<Large>::Make());
+        }
+    }).join();
+    CHECK(SharedPool<Large>::GetStats().slab_bytes - slab_bytes <= Pool::kSlabSize);
+}
+
+int main() {
+    TestReuse();
+    TestForeignReleases();
+    TestLargeSlots();
+}
@@ -0,0 +1,124 @@
+#include "shared/sharded.h"
+#include "shared/weak.h"
+#include "check.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+static std::atomic<int> alive = 0;
+
+struct Object {
+    Object() {
+        ++alive;
+    }
+    ~Object() {
+        --alive;
+    }
+    int value = 5;
+};
+
+using Ptr = SharedPtr<Object, ShardedCounting>;
+using Weak = WeakPtr<Object, ShardedCounting>;
+
+// Exact blocks do not carry the shards
+static_assert(sizeof(ShardedCounting) <= 32);
+
+void TestExactCounts() {
+    auto owner = MakeSharded<Object>();
+    Ptr first = owner.Share();
+    std::vector<Ptr> copies;
+    std::thread([&] { copies.assign(10, first); }).join();
+    CHECK(first.UseCount() == 12);
+    copies.clear();
+    CHECK(first.UseCount() == 2);
+    Weak weak = first;
+    CHECK(!weak.Expired() && weak.UseCount() == 2);
+}
+
+// A block has one owner at a time, the next one may take over after `Release`
+void TestHandOff() {
+    auto owner = MakeSharded<Object>();
+    Ptr object = owner.Share();
+    bool thrown = false;
+    try {
+        ShardedOwner<Object> second(object);
+    } catch (const BadShardedOwner&) {
+        thrown = true;
+    }
+    CHECK(thrown && object.UseCount() == 2);
+
+    // Moved owners keep the block sharded, the last one switches it back
+    ShardedOwner<Object> moved = std::move(owner);
+    CHECK(!owner && moved.Get() == object.Get());
+    std::thread([owner = std::move(moved)]() mutable {
+        CHECK(owner.Share().UseCount() == 3);
+    }).join();
+    CHECK(object.UseCount() == 1);
+
+    ShardedOwner<Object> next(object);
+    Ptr released = next.Release();
+    CHECK(!next && released.Get() == object.Get() && object.UseCount() == 2);
+    object.Reset();
+    released.Reset();
+    CHECK(alive == 0);
+}
+
+// Copies and weak pointers stay valid while the block switches back and forth
+void TestSwitches() {
+    Ptr object = MakeSharedWithPolicy<Object, ShardedCounting>();
+    Weak weak = object;
+    std::atomic<bool> stop = false;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, copy = object] {
+            while (!stop) {
+                Ptr local = copy;
+                Ptr locked = weak.Lock();
+                CHECK(locked && locked->value == 5);
+            }
+        });
+    }
+    for (int i = 0; i < 1000; ++i) {
+        ShardedOwner<Object> owner(object);
+        Ptr copy = owner.Share();
+        CHECK(owner.Release().Get() == copy.Get());
+    }
+    stop = true;
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    CHECK(object.UseCount() == 1);
+    object.Reset();
+    CHECK(alive == 0 && weak.Expired() && !weak.Lock());
+}
+
+// The last reference is dropped by a copy after the owner is gone
+void TestOwnerFirst() {
+    Weak weak;
+    for (int round = 0; round < 20; ++round) {
+        std::vector<std::thread> threads;
+        {
+            auto owner = MakeSharded<Object>();
+            weak = owner.Share();
+            for (int t = 0; t < 4; ++t) {
+                threads.emplace_back([copy = owner.Share()] {
+                    std::vector<Ptr> held(1000, copy);
+                    Weak local = copy;
+                    CHECK(local.Lock());
+                });
+            }
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        CHECK(alive == 0 && !weak.Lock());
+    }
+}
+
+int main() {
+    TestExactCounts();
+    TestHandOff();
+    TestSwitches();
+    TestOwnerFirst();
+}
@@ -0,0 +1,76 @@
+#include "shared/shared_ref.h"
+#include "check.h"
+
+#include <utility>
+
+struct Base {
+    int value = 1;
+};
+struct Derived : Base {};
+
+int Read(SharedRef<Base> ref) {
+    SharedRef<Base> copy = ref;
+    return copy->value;
+}
+
+// Handles that are gone before their source changes pass the checks
+void TestBorrows() {
+    auto object = MakeShared<Derived>();
+    CHECK(Read(object) == 1);
+    SharedPtr<Base> kept;
+    {
+        SharedRef<Base> ref = object;
+        kept = ref.Share();
+    }
+    object.Reset();
+    CHECK(kept.UseCount() == 1);
+    SharedPtr<Base> empty;
+    {
+        SharedRef<Base> ref = empty;
+        empty = kept;
+    }
+}
+
+// The source changes while a handle borrows from it, though the object is still alive
+void TestSourceChanges() {
+    CheckDies([] {
+        auto object = MakeShared<Base>();
+        auto copy = object;
+        SharedRef<Base> ref = object;
+        object.Reset();
+    });
+    CheckDies([] {
+        auto object = MakeShared<Base>();
+        SharedRef<Base> ref = object;
+        object = MakeShared<Base>();
+    });
+    CheckDies([] {
+        auto object = MakeShared<Base>();
+        SharedRef<Base> ref = object;
+        SharedPtr<Base> moved = std::move(object);
+    });
+    CheckDies([] {
+        auto copy = MakeShared<Base>();
+        SharedRef<Base> ref;
+        {
+            SharedPtr<Base> source = copy;
+            ref = source;
+        }
+    });
+}
+
+// A handle used after its object is gone
+void TestDeadObject() {
+    CheckDies([] {
+        auto object = MakeShared<Base>();
+        SharedRef<Base> ref = object;
+        SharedPtr<Base>::DestroyN(&object, 1);
+        CHECK(ref->value == 1);
+    });
+}
+
+int main() {
+    TestBorrows();
+    TestSourceChanges();
+    TestDeadObject();
+}
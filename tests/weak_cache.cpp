@@ -0,0 +1,105 @@
+#include "shared/weak_cache.h"
+#include "check.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Schema {
+    std::string name;
+};
+
+// Concurrent misses on one key call the loader once and share its result
+void TestSingleFlight() {
+    WeakCache<std::string, Schema> cache;
+    std::atomic<int> loads = 0;
+    auto loader = [&](const std::string& key) {
+        ++loads;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        return MakeShared<Schema>(Schema{key});
+    };
+    std::vector<SharedPtr<Schema>> results(8);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < results.size(); ++i) {
+        threads.emplace_back([&, i] { results[i] = cache.Get("a", loader); });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    CHECK(loads == 1);
+    for (const SharedPtr<Schema>& result : results) {
+        CHECK(result.Get() == results[0].Get() && result->name == "a");
+    }
+    CHECK(cache.Find("a").Get() == results[0].Get());
+
+    // Expired values are loaded again
+    results.clear();
+    CHECK(!cache.Find("a"));
+    CHECK(cache.Get("a", loader) && loads == 2);
+}
+
+// The waiters of a failed load get the loader's exception
+void TestThrowingLoader() {
+    WeakCache<std::string, Schema> cache;
+    std::atomic<int> loads = 0;
+    std::atomic<int> thrown = 0;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&] {
+            try {
+                cache.Get("bad", [&](const std::string&) -> SharedPtr<Schema> {
+                    ++loads;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                    throw std::runtime_error("load failed");
+                });
+            } catch (const std::runtime_error&) {
+                ++thrown;
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    CHECK(thrown == 4 && loads >= 1);
+    CHECK(!cache.Find("bad"));
+}
+
+// A loader that needs its own key fails instead of waiting for itself
+void TestRecursiveLoad() {
+    WeakCache<std::string, Schema> cache;
+    std::function<SharedPtr<Schema>(const std::string&)> loader = [&](const std::string& key) {
+        // "a" needs itself, "b" needs "c" and "c" needs "b"
+        if (key == "a") {
+            return cache.Get("a", loader);
+        }
+        return cache.Get(key == "b" ? "c" : "b", loader);
+    };
+    for (const char* key : {"a", "b"}) {
+        bool thrown = false;
+        try {
+            cache.Get(key, loader);
+        } catch (const BadRecursiveLoad&) {
+            thrown = true;
+        }
+        CHECK(thrown);
+    }
+    CHECK(cache.Size() == 0);
+
+    // Loaders may use other keys
+    auto load_base = [](const std::string& key) { return MakeShared<Schema>(Schema{key}); };
+    auto schema = cache.Get("a", [&](const std::string&) {
+        SharedPtr<Schema> base = cache.Get("base", load_base);
+        return MakeShared<Schema>(Schema{base->name + ".a"});
+    });
+    CHECK(schema->name == "base.a");
+}
+
+int main() {
+    TestSingleFlight();
+    TestThrowingLoader();
+    TestRecursiveLoad();
+}
@@ -7,31 +7,18 @@ template <class V>
 inline constexpr bool is_comp_v = std::is_empty_v<V> && !std::is_final_v<V>;
 
 // Me think, why waste time write lot code, when few code do trick.
+//
+// Empty types are base classes so they take no space. Copies and moves are the implicit
+// ones, so a pair is as cheap to move as its non-empty member.
 template <typename F, typename S, bool e1 = is_comp_v<F>, bool e2 = is_comp_v<S>>
 class CompressedPair {
 public:
-    CompressedPair() : first_(F()), second_(S()) {
+    CompressedPair() : first_(), second_() {
     }
 
-    CompressedPair(const F &first, const S &second) : first_(first), second_(second) {
-    }
-    CompressedPair(F &&first, const S &second) : first_(std::move(first)), second_(second) {
-    }
-    CompressedPair(const F &first, S &&second) : first_(first), second_(std::move(second)) {
-    }
-    CompressedPair(F &&first, S &&second) : first_(std::move(first)), second_(std::move(second)) {
-    }
-
-    CompressedPair(const CompressedPair &other) : first_(other.first_), second_(other.second_) {
-    }
-    CompressedPair(CompressedPair &&other)
-        : first_(std::move(other.first_)), second_(std::move(other.second_)) {
-    }
-
-    CompressedPair &operator=(CompressedPair &&other) {
-        first_ = std::move(other.first_);
-        second_ = std::move(other.second_);
-        return *this;
+    template <typename F2, typename S2>
+    CompressedPair(F2 &&first, S2 &&second)
+        : first_(std::forward<F2>(first)), second_(std::forward<S2>(second)) {
     }
 
     F &GetFirst() {
@@ -49,29 +36,21 @@ public:
     };
 
 private:
-    F first_;
-    S second_;
+    // Empty final types cannot be base classes, the attribute still lets them overlap with
+    // the other member
+    [[no_unique_address]] F first_;
+    [[no_unique_address]] S second_;
 };
 
 template <typename F, typename S>
 class CompressedPair<F, S, true, false> : public F {
 public:
-    CompressedPair() : second_(S()) {
+    CompressedPair() : F(), second_() {
     }
 
-    CompressedPair(const F &, const S &second) : second_(second) {
-    }
-    CompressedPair(const F &, S &&second) : second_(std::move(second)) {
-    }
-
-    CompressedPair(const CompressedPair &other) : second_(other.second_) {
-    }
-    CompressedPair(CompressedPair &&other) : second_(std::move(other.second_)) {
-    }
-
-    CompressedPair &operator=(CompressedPair &&other) {
-        second_ = std::move(other.second_);
-        return *this;
+    template <typename F2, typename S2>
+    CompressedPair(F2 &&first, S2 &&second)
+        : F(std::forward<F2>(first)), second_(std::forward<S2>(second)) {
     }
 
     F &GetFirst() {
@@ -89,28 +68,18 @@ public:
     };
 
 private:
-    S second_;
+    [[no_unique_address]] S second_;
 };
 
 template <typename F, typename S>
 class CompressedPair<F, S, false, true> : public S {
 public:
-    CompressedPair() : first_(F()) {
+    CompressedPair() : S(), first_() {
     }
 
-    CompressedPair(const F &first, const S &) : first_(first) {
-    }
-    CompressedPair(F &&first, const S &) : first_(std::move(first)) {
-    }
-
-    CompressedPair(const CompressedPair &other) : first_(other.first_) {
-    }
-    CompressedPair(CompressedPair &&other) : first_(std::move(other.first_)) {
-    }
-
-    CompressedPair &operator=(CompressedPair &&other) {
-        first_ = std::move(other.first_);
-        return *this;
+    template <typename F2, typename S2>
+    CompressedPair(F2 &&first, S2 &&second)
+        : S(std::forward<S2>(second)), first_(std::forward<F2>(first)) {
     }
 
     F &GetFirst() {
@@ -128,25 +97,18 @@ public:
     };
 
 private:
-    F first_;
+    [[no_unique_address]] F first_;
 };
 
 template <typename F, typename S>
 class CompressedPair<F, S, true, true> : public F, public S {
 public:
-    CompressedPair() {
-    }
-
-    CompressedPair(const F &, const S &) {
-    }
-
-    CompressedPair(const CompressedPair &) {
-    }
-    CompressedPair(CompressedPair &&) {
+    CompressedPair() : F(), S() {
     }
 
-    CompressedPair &operator=(CompressedPair &&) {
-        return *this;
+    template <typename F2, typename S2>
+    CompressedPair(F2 &&first, S2 &&second)
+        : F(std::forward<F2>(first)), S(std::forward<S2>(second)) {
     }
 
     F &GetFirst() {
@@ -164,30 +126,23 @@ public:
     };
 };
 
+// A class cannot have the same base twice. Empty objects of one type hold nothing that could
+// tell them apart, so a single base serves as both members.
 template <typename F>
 class CompressedPair<F, F, true, true> : public F {
 public:
-    CompressedPair() : first_(F()) {
-    }
-
-    CompressedPair(const F &, const F &) {
+    CompressedPair() : F() {
     }
 
-    CompressedPair(const CompressedPair &) {
-    }
-    CompressedPair(CompressedPair &&) {
-    }
-
-    CompressedPair &operator=(CompressedPair &&other) {
-        first_ = std::move(other.first_);
-        return *this;
+    template <typename F2, typename S2>
+    CompressedPair(F2 &&first, S2 &&) : F(std::forward<F2>(first)) {
     }
 
     F &GetFirst() {
-        return first_;
+        return *this;
     }
     const F &GetFirst() const {
-        return first_;
+        return *this;
     }
 
     F &GetSecond() {
@@ -196,7 +151,4 @@ public:
     const F &GetSecond() const {
         return *this;
     };
-
-private:
-    F first_;
 };
@@ -0,0 +1,277 @@
+#pragma once
+
+#include "unique.h"
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+struct ObjectPoolStats {
+    size_t hits = 0;     // acquisitions served from a free list
+    size_t misses = 0;   // acquisitions that allocated a new object
+    size_t returns = 0;  // objects put back on a free list
+    size_t drops = 0;    // objects freed on return because the free list was full
+    size_t trimmed = 0;  // idle objects freed by `ShrinkIdle`
+
+    double HitRate() const {
+        size_t total = hits + misses;
+        return total == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(total);
+    }
+};
+
+// Types that can be reused without being destroyed declare a reset hook next to the type,
+// found by argument-dependent lookup:
+//
+//     void PoolReset(T* object);  // brings `*object` back to its freshly constructed state
+template <typename T, typename = void>
+inline constexpr bool kPoolResettable = false;
+template <typename T>
+inline constexpr bool kPoolResettable<T, std::void_t<decltype(PoolReset(std::declval<T*>()))>> =
+    true;
+
+template <typename T>
+class ObjectPool;
+
+// Deleter of `ObjectPool` pointers, hands the object back to the pool of the releasing thread
+template <typename T>
+struct PoolReturn {
+    void operator()(T* object) const {
+        ObjectPool<T>::Return(object);
+    }
+};
+
+// Per-thread pool of `T` objects handed out as `UniquePtr<T, PoolReturn<T>>`, one pointer
+// wide.
+//
+// Releasing a pointer does not free the object but puts it on the free list of the releasing
+// thread, up to `Capacity()` objects; the next `Acquire` there reuses it. Objects of types with
+// a `PoolReset` hook stay constructed and are reset instead of destroyed, so `Acquire` returns
+// them without running a constructor. Other objects are destroyed and only their memory is
+// reused.
+//
+// `ShrinkIdle()` frees the objects that stayed on the calling thread's free list since its
+// previous call, call it when the thread is idle. Counters are kept per thread and published
+// every `kPublishInterval` operations, by `ShrinkIdle` and at thread exit, so `GetStats` lags
+// behind by a few operations per thread.
+template <typename T>
+class ObjectPool {
+    friend struct PoolReturn<T>;
+
+public:
+    using Ptr = UniquePtr<T, PoolReturn<T>>;
+
+    static constexpr size_t kDefaultCapacity = 64;
+    static constexpr size_t kPublishInterval = 64;
+
+    // Object from the free list or a new one. Pooled objects with a reset hook are returned
+    // as they are, so the arguments are only accepted for types without one.
+    template <typename... Args>
+    static Ptr Acquire(Args&&... args) {
+        static_assert(!kPoolResettable<T> || sizeof...(Args) == 0,
+                      "objects with a reset hook are reused without construction");
+        FreeList* list = list_gone ? nullptr : &List();
+        Slot* slot = list ? list->Pop() : nullptr;
+        if (slot != nullptr) {
+            list->Count(list->hits);
+            if constexpr (kPoolResettable<T>) {
+                return Ptr(slot->Object());
+            } else {
+                try {
+                    return Ptr(new (slot->bytes) T(std::forward<Args>(args)...));
+                } catch (...) {
+                    list->Push(slot);
+                    throw;
+                }
+            }
+        }
+        if (list) {
+            list->Count(list->misses);
+        } else {
+            misses.fetch_add(1, std::memory_order_relaxed);
+        }
+        slot = new Slot;
+        try {
+            return Ptr(new (slot->bytes) T(std::forward<Args>(args)...));
+        } catch (...) {
+            delete slot;
+            throw;
+        }
+    }
+
+    // Frees the objects of the calling thread that were not acquired since the previous
+    // call, and those above the capacity. Returns how many were freed.
+    static size_t ShrinkIdle() {
+        if (list_gone) {
+            return 0;
+        }
+        FreeList& list = List();
+        size_t capacity = Capacity();
+        size_t excess = list.size > capacity ? list.size - capacity : 0;
+        size_t count = list.Trim(list.low > excess ? list.low : excess);
+        list.trimmed += count;
+        list.Publish();
+        return count;
+    }
+
+    // Bound of every thread's free list, lowering it takes effect on the next return or
+    // `ShrinkIdle` of each thread
+    static void SetCapacity(size_t value) {
+        capacity.store(value, std::memory_order_relaxed);
+    }
+    static size_t Capacity() {
+        return capacity.load(std::memory_order_relaxed);
+    }
+
+    // Objects on the calling thread's free list
+    static size_t Cached() {
+        return list_gone ? 0 : List().size;
+    }
+
+    static ObjectPoolStats GetStats() {
+        ObjectPoolStats stats;
+        stats.hits = hits.load(std::memory_order_relaxed);
+        stats.misses = misses.load(std::memory_order_relaxed);
+        stats.returns = returns.load(std::memory_order_relaxed);
+        stats.drops = drops.load(std::memory_order_relaxed);
+        stats.trimmed = trimmed.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    // Storage of one object with the link that chains it on a free list
+    struct Slot {
+        T* Object() {
+            return reinterpret_cast<T*>(bytes);
+        }
+        static Slot* Of(T* object) {
+            return reinterpret_cast<Slot*>(reinterpret_cast<unsigned char*>(object) -
+                                           offsetof(Slot, bytes));
+        }
+
+        Slot* next;
+        alignas(T) unsigned char bytes[sizeof(T)];
+    };
+
+    class FreeList {
+    public:
+        ~FreeList() {
+            Trim(size);
+            Publish();
+            list_gone = true;
+        }
+
+        void Push(Slot* slot) {
+            slot->next = head_;
+            head_ = slot;
+            ++size;
+        }
+        Slot* Pop() {
+            if (head_ == nullptr) {
+                return nullptr;
+            }
+            Slot* slot = head_;
+            head_ = slot->next;
+            if (--size < low) {
+                low = size;
+            }
+            return slot;
+        }
+
+        // Frees the `count` objects returned longest ago and restarts the idle tracking
+        size_t Trim(size_t count) {
+            Slot** link = &head_;
+            for (size_t kept = size - count; kept != 0; --kept) {
+                link = &(*link)->next;
+            }
+            Slot* slot = *link;
+            *link = nullptr;
+            while (slot != nullptr) {
+                Free(std::exchange(slot, slot->next));
+            }
+            size -= count;
+            low = size;
+            return count;
+        }
+
+        void Count(size_t& counter) {
+            ++counter;
+            if (++events_ == kPublishInterval) {
+                Publish();
+            }
+        }
+        void Publish() {
+            ObjectPool::hits.fetch_add(std::exchange(hits, 0), std::memory_order_relaxed);
+            ObjectPool::misses.fetch_add(std::exchange(misses, 0), std::memory_order_relaxed);
+            ObjectPool::returns.fetch_add(std::exchange(returns, 0), std::memory_order_relaxed);
+            ObjectPool::drops.fetch_add(std::exchange(drops, 0), std::memory_order_relaxed);
+            ObjectPool::trimmed.fetch_add(std::exchange(trimmed, 0), std::memory_order_relaxed);
+            events_ = 0;
+        }
+
+        size_t size = 0;
+        // Fewest objects on the list since the last trim, none of them was used in between
+        size_t low = 0;
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t returns = 0;
+        size_t drops = 0;
+        size_t trimmed = 0;
+
+    private:
+        Slot* head_ = nullptr;
+        size_t events_ = 0;
+    };
+
+    static void Return(T* object) {
+        if (list_gone) {
+            drops.fetch_add(1, std::memory_order_relaxed);
+            Destroy(object);
+            return;
+        }
+        FreeList& list = List();
+        if (list.size >= Capacity()) {
+            list.Count(list.drops);
+            Destroy(object);
+            return;
+        }
+        if constexpr (kPoolResettable<T>) {
+            PoolReset(object);
+        } else {
+            object->~T();
+        }
+        list.Push(Slot::Of(object));
+        list.Count(list.returns);
+    }
+
+    static void Destroy(T* object) {
+        object->~T();
+        delete Slot::Of(object);
+    }
+    // Pooled objects are still alive only if they are reset instead of destroyed
+    static void Free(Slot* slot) {
+        if constexpr (kPoolResettable<T>) {
+            slot->Object()->~T();
+        }
+        delete slot;
+    }
+
+    static FreeList& List() {
+        thread_local FreeList list;
+        return list;
+    }
+
+    // Set once the calling thread's free list is destroyed, objects released later by other
+    // thread_local destructors are freed right away
+    static inline thread_local bool list_gone = false;
+
+    static inline std::atomic<size_t> capacity = kDefaultCapacity;
+    static inline std::atomic<size_t> hits = 0;
+    static inline std::atomic<size_t> misses = 0;
+    static inline std::atomic<size_t> returns = 0;
+    static inline std::atomic<size_t> drops = 0;
+    static inline std::atomic<size_t> trimmed = 0;
+};
+
+static_assert(sizeof(ObjectPool<int>::Ptr) == sizeof(int*));
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// A type is trivially relocatable if moving an object to a new address and ending the
+// lifetime of the old one can be done by copying its bytes. Trivially copyable types are,
+// and so are the smart pointers, which hold no pointers into themselves. Other types may
+// specialize the trait.
+template <typename T>
+struct IsTriviallyRelocatable : std::bool_constant<std::is_trivially_copyable_v<T>> {};
+
+template <typename T>
+inline constexpr bool kTriviallyRelocatable = IsTriviallyRelocatable<T>::value;
+
+// Moves `count` objects from `source` into uninitialized memory at `target` and ends their
+// lifetime in `source`, the ranges must not overlap
+template <typename T>
+void RelocateN(T* source, size_t count, T* target) noexcept {
+    static_assert(kTriviallyRelocatable<T> || std::is_nothrow_move_constructible_v<T>,
+                  "relocation must not throw");
+    if constexpr (kTriviallyRelocatable<T>) {
+        if (count != 0) {
+            std::memcpy(static_cast<void*>(target), static_cast<const void*>(source),
+                        count * sizeof(T));
+        }
+    } else {
+        for (size_t i = 0; i < count; ++i) {
+            new (target + i) T(std::move(source[i]));
+            source[i].~T();
+        }
+    }
+}
+
+// Growable array that relocates its elements instead of moving them one by one. Storage of
+// trivially relocatable types is grown with `realloc`, which can often extend it in place.
+template <typename T>
+class RelocatingVector {
+    static_assert(kTriviallyRelocatable<T> || std::is_nothrow_move_constructible_v<T>,
+                  "elements must be relocatable without throwing");
+
+    // `realloc` only guarantees the fundamental alignment
+    static constexpr bool kRealloc =
+        kTriviallyRelocatable<T> && alignof(T) <= alignof(std::max_align_t);
+
+public:
+    RelocatingVector() = default;
+
+    RelocatingVector(const RelocatingVector&) = delete;
+    RelocatingVector& operator=(const RelocatingVector&) = delete;
+
+    RelocatingVector(RelocatingVector&& other) noexcept
+        : data_(std::exchange(other.data_, nullptr)),
+          size_(std::exchange(other.size_, 0)),
+          capacity_(std::exchange(other.capacity_, 0)) {
+    }
+    RelocatingVector& operator=(RelocatingVector&& other) noexcept {
+        RelocatingVector(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    ~RelocatingVector() {
+        Clear();
+        Free(data_);
+    }
+
+    // Modifiers
+
+    template <typename... Args>
+    T& EmplaceBack(Args&&... args) {
+        if (size_ < capacity_) {
+            return *new (data_ + size_++) T(std::forward<Args>(args)...);
+        }
+        // The arguments may refer to elements, so the new one is built before they move
+        size_t capacity = capacity_ == 0 ? 4 : capacity_ * 2;
+        if constexpr (kRealloc) {
+            alignas(T) unsigned char bytes[sizeof(T)];
+            T* value = new (bytes) T(std::forward<Args>(args)...);
+            try {
+                Grow(capacity);
+            } catch (...) {
+                value->~T();
+                throw;
+            }
+            RelocateN(value, 1, data_ + size_);
+        } else {
+            T* data = Allocate(capacity);
+            try {
+                new (data + size_) T(std::forward<Args>(args)...);
+            } catch (...) {
+                Free(data);
+                throw;
+            }
+            RelocateN(data_, size_, data);
+            Free(data_);
+            data_ = data;
+            capacity_ = capacity;
+        }
+        return data_[size_++];
+    }
+    void PushBack(T value) {
+        EmplaceBack(std::move(value));
+    }
+    void PopBack() {
+        data_[--size_].~T();
+    }
+    void Clear() {
+        while (size_ != 0) {
+            PopBack();
+        }
+    }
+    void Reserve(size_t capacity) {
+        if (capacity <= capacity_) {
+            return;
+        }
+        if constexpr (kRealloc) {
+            Grow(capacity);
+        } else {
+            T* data = Allocate(capacity);
+            RelocateN(data_, size_, data);
+            Free(data_);
+            data_ = data;
+            capacity_ = capacity;
+        }
+    }
+    void Swap(RelocatingVector& other) {
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(capacity_, other.capacity_);
+    }
+
+    // Observers
+
+    size_t Size() const {
+        return size_;
+    }
+    size_t Capacity() const {
+        return capacity_;
+    }
+    bool Empty() const {
+        return size_ == 0;
+    }
+    T* Data() {
+        return data_;
+    }
+    const T* Data() const {
+        return data_;
+    }
+    T& operator[](size_t index) {
+        return data_[index];
+    }
+    const T& operator[](size_t index) const {
+        return data_[index];
+    }
+    T* begin() {
+        return data_;
+    }
+    T* end() {
+        return data_ + size_;
+    }
+    const T* begin() const {
+        return data_;
+    }
+    const T* end() const {
+        return data_ + size_;
+    }
+
+private:
+    // `realloc` moves the bytes of the elements, which relocates them
+    void Grow(size_t capacity) {
+        void* data = std::realloc(static_cast<void*>(data_), capacity * sizeof(T));
+        if (data == nullptr) {
+            throw std::bad_alloc();
+        }
+        data_ = static_cast<T*>(data);
+        capacity_ = capacity;
+    }
+
+    static T* Allocate(size_t capacity) {
+        return static_cast<T*>(::operator new(capacity * sizeof(T), std::align_val_t(alignof(T))));
+    }
+    static void Free(T* data) {
+        if constexpr (kRealloc) {
+            std::free(static_cast<void*>(data));
+        } else {
+            ::operator delete(static_cast<void*>(data), std::align_val_t(alignof(T)));
+        }
+    }
+
+    T* data_ = nullptr;
+    size_t size_ = 0;
+    size_t capacity_ = 0;
+};
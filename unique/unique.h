@@ -1,8 +1,11 @@
 #pragma once
 
 #include "compressed_pair.h"
+#include "relocate.h"
 
 #include <cstddef>
+#include <type_traits>
+#include <utility>
 
 template <typename T>
 struct Slug {
@@ -43,48 +46,34 @@ public:
     }
 
     template <typename U, typename Deleter2>
-    UniquePtr(UniquePtr<U, Deleter2>&& other) noexcept {
-        pair_.GetSecond()(pair_.GetFirst());
-        pair_.GetFirst() = nullptr;
-
-        pair_.GetFirst() = std::move(static_cast<T*>(other.Release()));
-        pair_.GetSecond() = std::move(other.GetDeleter());
+    UniquePtr(UniquePtr<U, Deleter2>&& other) noexcept
+        : pair_(static_cast<T*>(other.Release()), Deleter(std::move(other.GetDeleter()))) {
     }
 
-    UniquePtr(UniquePtr&& other) noexcept {
-        pair_.GetSecond()(pair_.GetFirst());
-        pair_.GetFirst() = nullptr;
-
-        pair_ =
-            CompressedPair(std::move(other.pair_.GetFirst()), std::move(other.pair_.GetSecond()));
-        other.pair_.GetFirst() = nullptr;
+    // Moves never touch the deleter of the new pointer, which holds nothing to delete
+    UniquePtr(UniquePtr&& other) noexcept
+        : pair_(other.Release(), std::move(other.GetDeleter())) {
     }
 
     // `operator=`-s
 
+    // Releasing `other` first makes self-assignment a no-op without checking for it
     UniquePtr& operator=(UniquePtr&& other) noexcept {
-        if (&other == this) {
-            return *this;
-        }
-        pair_.GetSecond()(pair_.GetFirst());
-        pair_.GetFirst() = nullptr;
-
-        pair_ =
-            CompressedPair(std::move(other.pair_.GetFirst()), std::move(other.pair_.GetSecond()));
-        other.pair_.GetFirst() = nullptr;
+        Reset(other.Release());
+        pair_.GetSecond() = std::move(other.pair_.GetSecond());
         return *this;
     }
     UniquePtr& operator=(std::nullptr_t) {
-        pair_.GetSecond()(pair_.GetFirst());
-        pair_.GetFirst() = nullptr;
+        Reset();
         return *this;
     }
 
     // Destructor
 
     ~UniquePtr() {
-        pair_.GetSecond()(pair_.GetFirst());
-        pair_.GetFirst() = nullptr;
+        if (pair_.GetFirst()) {
+            pair_.GetSecond()(pair_.GetFirst());
+        }
     }
 
     // Modifiers
@@ -94,18 +83,17 @@ public:
         pair_.GetFirst() = nullptr;
         return result;
     }
+    // The new pointer is stored first, destroying the old object may reach this pointer
     void Reset(T* ptr = nullptr) {
-        T* tmp = pair_.GetFirst();
-        pair_.GetFirst() = nullptr;
-        pair_.GetSecond()(tmp);
-        if (ptr != nullptr) {
-            pair_.GetFirst() = ptr;
+        T* old = std::exchange(pair_.GetFirst(), ptr);
+        if (old) {
+            pair_.GetSecond()(old);
         }
     }
-    void Swap(UniquePtr& other) {
-        CompressedPair<T*, Deleter> tmp(std::move(pair_));
-        pair_ = std::move(other.pair_);
-        other.pair_ = std::move(tmp);
+    void Swap(UniquePtr& other) noexcept {
+        using std::swap;
+        swap(pair_.GetFirst(), other.pair_.GetFirst());
+        swap(pair_.GetSecond(), other.pair_.GetSecond());
     }
 
     // Observers
@@ -148,48 +136,34 @@ public:
     }
 
     template <typename U, typename Deleter2>
-    UniquePtr(UniquePtr<U, Deleter2>&& other) noexcept {
-        pair_.GetSecond()(pair_.GetFirst());
-        pair_.GetFirst() = nullptr;
-
-        pair_.GetFirst() = std::move(static_cast<T*>(other.Release()));
-        pair_.GetSecond() = std::move(other.GetDeleter());
+    UniquePtr(UniquePtr<U, Deleter2>&& other) noexcept
+        : pair_(static_cast<T*>(other.Release()), Deleter(std::move(other.GetDeleter()))) {
     }
 
-    UniquePtr(UniquePtr&& other) noexcept {
-        pair_.GetSecond()(pair_.GetFirst());
-        pair_.GetFirst() = nullptr;
-
-        pair_ =
-            CompressedPair(std::move(other.pair_.GetFirst()), std::move(other.pair_.GetSecond()));
-        other.pair_.GetFirst() = nullptr;
+    // Moves never touch the deleter of the new pointer, which holds nothing to delete
+    UniquePtr(UniquePtr&& other) noexcept
+        : pair_(other.Release(), std::move(other.GetDeleter())) {
     }
 
     // `operator=`-s
 
+    // Releasing `other` first makes self-assignment a no-op without checking for it
     UniquePtr& operator=(UniquePtr&& other) noexcept {
-        if (&other == this) {
-            return *this;
-        }
-        pair_.GetSecond()(pair_.GetFirst());
-        pair_.GetFirst() = nullptr;
-
-        pair_ =
-            CompressedPair(std::move(other.pair_.GetFirst()), std::move(other.pair_.GetSecond()));
-        other.pair_.GetFirst() = nullptr;
+        Reset(other.Release());
+        pair_.GetSecond() = std::move(other.pair_.GetSecond());
         return *this;
     }
     UniquePtr& operator=(std::nullptr_t) {
-        pair_.GetSecond()(pair_.GetFirst());
-        pair_.GetFirst() = nullptr;
+        Reset();
         return *this;
     }
 
     // Destructor
 
     ~UniquePtr() {
-        pair_.GetSecond()(pair_.GetFirst());
-        pair_.GetFirst() = nullptr;
+        if (pair_.GetFirst()) {
+            pair_.GetSecond()(pair_.GetFirst());
+        }
     }
 
     // Modifiers
@@ -199,18 +173,17 @@ public:
         pair_.GetFirst() = nullptr;
         return result;
     }
+    // The new pointer is stored first, destroying the old object may reach this pointer
     void Reset(T* ptr = nullptr) {
-        T* tmp = pair_.GetFirst();
-        pair_.GetFirst() = nullptr;
-        pair_.GetSecond()(tmp);
-        if (ptr != nullptr) {
-            pair_.GetFirst() = ptr;
+        T* old = std::exchange(pair_.GetFirst(), ptr);
+        if (old) {
+            pair_.GetSecond()(old);
         }
     }
-    void Swap(UniquePtr& other) {
-        CompressedPair<T*, Deleter> tmp(std::move(pair_));
-        pair_ = std::move(other.pair_);
-        other.pair_ = std::move(tmp);
+    void Swap(UniquePtr& other) noexcept {
+        using std::swap;
+        swap(pair_.GetFirst(), other.pair_.GetFirst());
+        swap(pair_.GetSecond(), other.pair_.GetSecond());
     }
 
     // Observers
@@ -243,3 +216,35 @@ public:
 private:
     CompressedPair<T*, Deleter> pair_;
 };
+
+// `MakeUnique<T>(args...)` constructs an object, `MakeUnique<T[]>(size)` value-initializes
+// `size` elements
+template <typename T, typename... Args>
+std::enable_if_t<!std::is_array_v<T>, UniquePtr<T>> MakeUnique(Args&&... args) {
+    return UniquePtr<T>(new T(std::forward<Args>(args)...));
+}
+template <typename T>
+std::enable_if_t<std::is_array_v<T> && std::extent_v<T> == 0, UniquePtr<T>> MakeUnique(
+    size_t size) {
+    return UniquePtr<T>(new std::remove_extent_t<T>[size]());
+}
+
+// Default-initializing variants, objects and elements of trivial types are not zeroed
+template <typename T>
+std::enable_if_t<!std::is_array_v<T>, UniquePtr<T>> MakeUniqueForOverwrite() {
+    return UniquePtr<T>(new T);
+}
+template <typename T>
+std::enable_if_t<std::is_array_v<T> && std::extent_v<T> == 0, UniquePtr<T>>
+MakeUniqueForOverwrite(size_t size) {
+    return UniquePtr<T>(new std::remove_extent_t<T>[size]);
+}
+
+// Empty deleters take no space
+static_assert(sizeof(UniquePtr<int>) == sizeof(int*));
+static_assert(sizeof(UniquePtr<int[]>) == sizeof(int*));
+static_assert(sizeof(CompressedPair<Slug<int>, Slug<int>>) == 1);
+
+// Moving a `UniquePtr` moves the pointer and the deleter, so it relocates like its deleter
+template <typename T, typename Deleter>
+struct IsTriviallyRelocatable<UniquePtr<T, Deleter>> : IsTriviallyRelocatable<Deleter> {};